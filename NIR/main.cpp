@@ -3,29 +3,121 @@
 #include <fstream>
 #include <string>
 #include <iomanip>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
 #include <stack>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <variant>
+#include <optional>
+#include <span>
+#include <charconv>
+#include <memory_resource>
+#ifdef NIR_BENCH_KERNELS
+#include <chrono>
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define NIR_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 using json = nlohmann::json;
 
+//Сборка с -DNIR_COUNT_ALLOCS считает выделения памяти: обращения к куче (глобальный operator new)
+//и запросы к пулу трассы - кнф получают его через CountingResource, так что видны и выделения,
+//которые пул отдает из уже набранных блоков. makeBoolLinks записывает число выделений на каждое
+//событие в eventAllocations(); с ключом --check-allocs=N программа завершается с ошибкой,
+//если после первых N событий (прогрев) выделяло память устоявшееся событие - не менявшее
+//состав компонент (componentShape)
+//Сборка с -DNIR_CHECK_DIVIDE сверяет разделения без полного обхода (CNF::divideLocal) с полной разметкой
+#ifdef NIR_COUNT_ALLOCS
+static std::size_t heapAllocations = 0;
+static std::size_t poolAllocations = 0;
+
+//замены new и delete не встраиваются: встроенные malloc и free gcc сопоставляет с operator new/delete
+//в местах вызова и предупреждает о несовпадении пар (-Wmismatched-new-delete)
+[[gnu::noinline]] void* operator new(std::size_t n) {
+    heapAllocations++;
+    if (void *p = std::malloc(n == 0 ? 1 : n)) return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void* operator new(std::size_t n, std::align_val_t al) {
+    heapAllocations++;
+    std::size_t a = (std::size_t)al;
+    if (void *p = std::aligned_alloc(a, (n + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void *p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+static std::size_t allocations() {
+    return heapAllocations + poolAllocations;
+}
+
+struct EventAllocations {
+    std::size_t count = 0;
+    bool steady = false;          //состав компонент после события не изменился
+};
+
+static std::vector<EventAllocations>& eventAllocations() {
+    static std::vector<EventAllocations> counts;
+    return counts;
+}
+
+//Обертка над ресурсом, считающая каждый запрос памяти
+class CountingResource : public std::pmr::memory_resource {
+private:
+    std::pmr::memory_resource *upstream;
+    
+    void* do_allocate(std::size_t bytes, std::size_t align) override {
+        poolAllocations++;
+        return upstream->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, std::size_t bytes, std::size_t align) override {
+        upstream->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+    
+public:
+    explicit CountingResource(std::pmr::memory_resource *res) : upstream(res) {}
+};
+#endif
+
 using Clause = std::pair<int, int>;
 using Formula = std::vector<Clause>;
 // DPLL SAT Solver для произвольных формул
 class DPLLSolver {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    using Clauses = std::pmr::vector<std::pmr::vector<int>>;
+    using Assignment = std::pmr::unordered_map<int, bool>;
+
 private:
-    std::vector<std::vector<int>> clauses;
-    std::unordered_map<int, bool> assignment;
-    std::vector<int> variables;
+    allocator_type alloc;        // все копии клауз и присваиваний при переборе берут память отсюда
+    Clauses clauses;
+    Assignment assignment;
+    std::pmr::vector<int> variables;
 
 public:
-    DPLLSolver() {}
+    explicit DPLLSolver(const allocator_type& a = {}) : alloc(a), clauses(a), assignment(a), variables(a) {}
     
     // Добавить клаузу
     void addClause(const std::vector<int>& clause) {
-        clauses.push_back(clause);
+        clauses.emplace_back(clause.begin(), clause.end());
         // Добавляем переменные в список
         for (int lit : clause) {
             int var = std::abs(lit);
@@ -45,7 +137,7 @@ public:
     // Решить задачу
     bool solve() {
         assignment.clear();
-        return dpll(clauses, assignment);
+        return dpll(Clauses(clauses, alloc), Assignment(assignment, alloc));
     }
     
     // Получить значение переменной в решении
@@ -58,24 +150,23 @@ public:
     }
     
     // Получить все присваивания
-    const std::unordered_map<int, bool>& getAssignment() const {
+    const Assignment& getAssignment() const {
         return assignment;
     }
     
     // Получить список всех переменных
-    const std::vector<int>& getVariables() const {
+    const std::pmr::vector<int>& getVariables() const {
         return variables;
     }
 
 private:
-    bool dpll(std::vector<std::vector<int>> currentClauses,
-              std::unordered_map<int, bool> currentAssignment) {
+    bool dpll(Clauses currentClauses, Assignment currentAssignment) {
         
         // Упрощение: распространение unit clauses
         bool changed;
         do {
             changed = false;
-            std::vector<std::vector<int>> newClauses;
+            Clauses newClauses(alloc);
             
             for (const auto& clause : currentClauses) {
                 if (clause.size() == 1) {
@@ -96,7 +187,7 @@ private:
             
             // Удалить удовлетворенные клаузы и противоречивые литералы
             for (const auto& clause : currentClauses) {
-                std::vector<int> newClause;
+                std::pmr::vector<int> newClause(alloc);
                 bool clauseSatisfied = false;
                 
                 for (int lit : clause) {
@@ -122,11 +213,11 @@ private:
                         // Пустая клауза - противоречие
                         return false;
                     }
-                    newClauses.push_back(newClause);
+                    newClauses.push_back(std::move(newClause));
                 }
             }
             
-            currentClauses = newClauses;
+            currentClauses = std::move(newClauses);
             
         } while (changed && !currentClauses.empty());
         
@@ -141,23 +232,23 @@ private:
         if (var == -1) return false;
         
         // Попробовать присвоить true
-        auto newClausesTrue = currentClauses;
+        Clauses newClausesTrue(currentClauses, alloc);
         newClausesTrue.push_back({var});
-        auto newAssignmentTrue = currentAssignment;
+        Assignment newAssignmentTrue(currentAssignment, alloc);
         
-        if (dpll(newClausesTrue, newAssignmentTrue)) {
+        if (dpll(std::move(newClausesTrue), std::move(newAssignmentTrue))) {
             return true;
         }
         
         // Попробовать присвоить false
-        auto newClausesFalse = currentClauses;
+        Clauses newClausesFalse(currentClauses, alloc);
         newClausesFalse.push_back({-var});
-        auto newAssignmentFalse = currentAssignment;
+        Assignment newAssignmentFalse(currentAssignment, alloc);
         
-        return dpll(newClausesFalse, newAssignmentFalse);
+        return dpll(std::move(newClausesFalse), std::move(newAssignmentFalse));
     }
     
-    int chooseVariable(const std::vector<std::vector<int>>& clauses) {
+    int chooseVariable(const Clauses& clauses) {
         if (clauses.empty()) return -1;
         
         // Простая эвристика: выбрать первую переменную из первой не-unit клаузы
@@ -179,60 +270,250 @@ private:
     }
 };
 
+//Ядра проходов по массивам 64-битных слов - строкам BitMatrix и BoolVector.
+//Реализация выбирается один раз при запуске по возможностям процессора (CPUID): AVX-512, AVX2
+//или скалярная. Переменная окружения NIR_SIMD=scalar|avx2|avx512 ограничивает выбор - так сравниваются
+//реализации (tests/bench_kernels.sh) и проверяется скалярная на машинах с AVX
+struct BitKernels {
+    bool (*anyWords)(const std::uint64_t*, int);                        //есть ли ненулевое слово
+    bool (*equalWords)(const std::uint64_t*, const std::uint64_t*, int);
+    void (*orWords)(std::uint64_t*, const std::uint64_t*, int);         //dst |= a
+    void (*andNotWords)(std::uint64_t*, const std::uint64_t*, int);     //dst &= ~a
+    const char *name;
+};
+
+static void orWordsScalar(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i++) dst[i] |= a[i];
+}
+
+static void andNotWordsScalar(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i++) dst[i] &= ~a[i];
+}
+
+static bool anyWordsScalar(const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != 0) return true;
+    }
+    return false;
+}
+
+static bool equalWordsScalar(const std::uint64_t *a, const std::uint64_t *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+#ifdef NIR_X86_SIMD
+__attribute__((target("avx2")))
+static void orWordsAVX2(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(a + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(x, y));
+    }
+    for (; i < n; i++) dst[i] |= a[i];
+}
+
+__attribute__((target("avx2")))
+static void andNotWordsAVX2(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(a + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_andnot_si256(y, x));
+    }
+    for (; i < n; i++) dst[i] &= ~a[i];
+}
+
+__attribute__((target("avx2")))
+static bool anyWordsAVX2(const std::uint64_t *a, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        if (!_mm256_testz_si256(x, x)) return true;
+    }
+    for (; i < n; i++) {
+        if (a[i] != 0) return true;
+    }
+    return false;
+}
+
+__attribute__((target("avx2")))
+static bool equalWordsAVX2(const std::uint64_t *a, const std::uint64_t *b, int n) {
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i d = _mm256_xor_si256(x, y);
+        if (!_mm256_testz_si256(d, d)) return false;
+    }
+    for (; i < n; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+//для AVX-512 хвост обрабатывается маскированными загрузками
+__attribute__((target("avx512f")))
+static void orWordsAVX512(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 k = (n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512i x = _mm512_maskz_loadu_epi64(k, dst + i);
+        __m512i y = _mm512_maskz_loadu_epi64(k, a + i);
+        _mm512_mask_storeu_epi64(dst + i, k, _mm512_or_si512(x, y));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void andNotWordsAVX512(std::uint64_t *dst, const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 k = (n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512i x = _mm512_maskz_loadu_epi64(k, dst + i);
+        __m512i y = _mm512_maskz_loadu_epi64(k, a + i);
+        _mm512_mask_storeu_epi64(dst + i, k, _mm512_maskz_andnot_epi64(k, y, x));
+    }
+}
+
+__attribute__((target("avx512f")))
+static bool anyWordsAVX512(const std::uint64_t *a, int n) {
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 k = (n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512i x = _mm512_maskz_loadu_epi64(k, a + i);
+        if (_mm512_test_epi64_mask(x, x) != 0) return true;
+    }
+    return false;
+}
+
+__attribute__((target("avx512f")))
+static bool equalWordsAVX512(const std::uint64_t *a, const std::uint64_t *b, int n) {
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 k = (n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (n - i)) - 1);
+        __m512i x = _mm512_maskz_loadu_epi64(k, a + i);
+        __m512i y = _mm512_maskz_loadu_epi64(k, b + i);
+        if (_mm512_mask_cmpneq_epi64_mask(k, x, y) != 0) return false;
+    }
+    return true;
+}
+#endif
+
+static const BitKernels scalarBitKernels = {anyWordsScalar, equalWordsScalar, orWordsScalar, andNotWordsScalar, "scalar"};
+
+//лучшая реализация, доступная процессору и не выше limit (NIR_SIMD)
+static BitKernels selectBitKernels(const char *limit) {
+    std::string allowed = limit ? limit : "avx512";
+#ifdef NIR_X86_SIMD
+    __builtin_cpu_init();
+    if (allowed == "avx512" && __builtin_cpu_supports("avx512f")) {
+        return {anyWordsAVX512, equalWordsAVX512, orWordsAVX512, andNotWordsAVX512, "avx512"};
+    }
+    if ((allowed == "avx512" || allowed == "avx2") && __builtin_cpu_supports("avx2")) {
+        return {anyWordsAVX2, equalWordsAVX2, orWordsAVX2, andNotWordsAVX2, "avx2"};
+    }
+#endif
+    return scalarBitKernels;
+}
+
+static const BitKernels& bitKernels() {
+    static const BitKernels kernels = selectBitKernels(std::getenv("NIR_SIMD"));
+    return kernels;
+}
+
+//Сколько бит BoolVector хранит внутри объекта без обращения к куче.
+//Строки компонент до этой длины не выделяют память вообще.
+#ifndef NIR_BOOLVECTOR_INLINE_BITS
+#define NIR_BOOLVECTOR_INLINE_BITS 128
+#endif
+
 class BoolVector {
 private:
-    unsigned char *v;
+    static constexpr int inlineWords = (NIR_BOOLVECTOR_INLINE_BITS + 63) / 64 > 0 ? (NIR_BOOLVECTOR_INLINE_BITS + 63) / 64 : 1;
+    
+    std::uint64_t *v;         //биты хранятся 64-битными словами, биты за пределами nbit всегда равны 0
     int nbit;
-    int m;
+    int m;                    //количество слов
+    int cap;                  //сколько слов помещается в текущий буфер
+    std::uint64_t local[inlineWords];   //встроенный буфер, v указывает на него, пока хватает места
+    std::pmr::polymorphic_allocator<std::uint64_t> alloc;       //откуда берется буфер, когда встроенного мало
     
     void resizeA(int);
+    void clearTail();
+    void reserveWords(int);
+    void releaseHeap();
+    
+    static int wordsFor(int n) {
+        return (n + 63) / 64;
+    }
     
 public:
-    BoolVector(int nn = 1);
+    using allocator_type = std::pmr::polymorphic_allocator<std::uint64_t>;
+    
+    BoolVector(int nn = 1, const allocator_type & = {});
     BoolVector(const char*);
     BoolVector(const BoolVector &);
+    BoolVector(const BoolVector &, const allocator_type &);
+    BoolVector(BoolVector &&) noexcept;
     ~BoolVector();
     
+    allocator_type get_allocator() const {
+        return alloc;
+    }
+    
     void Set1(int);
     void Set0(int);
     int operator[](int);
     int operator[](int)const;
-    BoolVector operator = (const BoolVector &);
+    BoolVector& operator = (const BoolVector &);
+    BoolVector& operator = (BoolVector &&) noexcept;
     
     bool operator == (const BoolVector &) const;
     
-    BoolVector operator | (const BoolVector &) const;
-    BoolVector operator & (const BoolVector &) const;
-    BoolVector operator ~() const;
+    //на месте, без временных векторов: одна операция ядра над словами
+    BoolVector& operator |= (const BoolVector &);   //длина растет до длины аргумента
+    BoolVector& andNot(const BoolVector &);         //обнуляет биты, установленные в аргументе
+    void Clear();                               //обнуляет все биты, длина сохраняется
     
+    int bitCount() const {
+        return nbit;
+    }
     bool hasWeight() const;
     bool hasPrev() const;
-    int getLink();
-    int getLinkZeroIncluded();
-    int getWeight();
+    int getLink() const;
+    int getLinkZeroIncluded() const;
+    int getLastLink() const;
+    int getWeight() const;
+    
+    //вызывает f(j) для каждого единичного бита j по возрастанию, перескакивая нулевые слова
+    template<class F>
+    void forEachSetBit(F &&f) const {
+        for (int i = 0; i < m; i++) {
+            for (std::uint64_t w = v[i]; w != 0; w &= w - 1) {
+                f(i * 64 + std::countr_zero(w));
+            }
+        }
+    }
     
     friend std::ostream& operator << (std::ostream&, const BoolVector &);
     friend std::istream& operator >> (std::istream&, BoolVector &);
     
     friend class CNF;
+    friend class PtrRow;
 };
 
-BoolVector::BoolVector(int nn){
+BoolVector::BoolVector(int nn, const allocator_type &a) : alloc(a) {
+    v = local;
+    cap = inlineWords;
     nbit = nn;
-    m = (nn + 7) / 8;
-    v = new unsigned char[m];
-    for(int i = 0; i < m; i++){
-        v[i] = 0;
+    m = wordsFor(nn);
+    if (m > cap) {
+        v = alloc.allocate(m);
+        cap = m;
     }
+    std::fill(v, v + m, 0);
 }
 
-BoolVector::BoolVector(const char* str){
-    nbit = (int)strlen(str);
-    m = (nbit + 7) / 8;
-    v = new unsigned char[m];
-    for(int i=0; i<m; i++){
-        v[i] = 0;
-    }
+BoolVector::BoolVector(const char* str) : BoolVector((int)strlen(str)){
     for(int i=0; i<nbit; i++){
         if(str[i] == '1'){
             Set1(i);
@@ -240,161 +521,197 @@ BoolVector::BoolVector(const char* str){
     }
 }
 
-BoolVector::BoolVector(const BoolVector &other){
+BoolVector::BoolVector(const BoolVector &other) : BoolVector(other, allocator_type()) {}
+
+BoolVector::BoolVector(const BoolVector &other, const allocator_type &a) : alloc(a) {
+    v = local;
+    cap = inlineWords;
+    nbit = 0;
+    m = 0;
+    *this = other;
+}
+
+//из кучи буфер забираем вместе с его ресурсом, встроенный приходится копировать
+BoolVector::BoolVector(BoolVector &&other) noexcept : alloc(other.alloc) {
     nbit = other.nbit;
     m = other.m;
-    v = new unsigned char[m]();
-    for(int i=0; i<m; i++){
-        v[i] = other.v[i];
+    if (other.v == other.local) {
+        v = local;
+        cap = inlineWords;
+        std::copy(other.local, other.local + m, local);
+    } else {
+        v = other.v;
+        cap = other.cap;
+        other.v = other.local;
+        other.cap = inlineWords;
     }
+    other.nbit = 0;
+    other.m = 0;
 }
 
 BoolVector::~BoolVector(){
-    delete [] v;
+    releaseHeap();
+}
+
+void BoolVector::releaseHeap() {
+    if (v != local) {
+        alloc.deallocate(v, cap);
+        v = local;
+        cap = inlineWords;
+    }
+}
+
+//гарантирует буфер не меньше Nm слов, первые m слов сохраняются
+void BoolVector::reserveWords(int Nm) {
+    if (Nm <= cap) return;
+    std::uint64_t *Nv = alloc.allocate(Nm);
+    std::copy(v, v + m, Nv);
+    releaseHeap();
+    v = Nv;
+    cap = Nm;
+}
+
+//обнуляем биты последнего слова, лежащие за пределами nbit
+void BoolVector::clearTail() {
+    if (m > 0 && nbit % 64 != 0) {
+        v[m - 1] &= (std::uint64_t(1) << (nbit % 64)) - 1;
+    }
 }
 
 void BoolVector::Set1(int index){
     if (index >= nbit) resizeA(index + 1);
-    v[index/8] |= (1 << (index%8));
+    v[index/64] |= std::uint64_t(1) << (index%64);
 }
 
 void BoolVector::Set0(int index){
-    if (index >= nbit) resizeA(m+1);
-    v[index/8] &= ~(1 << (index%8));
+    if (index >= nbit) return;                  //за пределами nbit биты и так нулевые
+    v[index/64] &= ~(std::uint64_t(1) << (index%64));
 }
 
 int BoolVector::operator[](int index){
-    return (v[index/8] >> (index%8)) & 1;
+    return std::as_const(*this)[index];
 }
 
 int BoolVector::operator[](int index) const{
-    return (v[index/8] >> (index%8)) & 1;
+    if (index >= nbit) return 0;
+    return (v[index/64] >> (index%64)) & 1;
 }
 
 void BoolVector::resizeA(int Nnbit) {
-    int Nm = (Nnbit + 7) / 8;
-    unsigned char *Nv = new unsigned char[Nm]();
+    int Nm = wordsFor(Nnbit);
     
-    if (Nnbit > nbit) {
-        for(int i = 0; i <= nbit; i++) {
-            Nv[i] = v[i];
-        }
-    } else {
-        for(int i = 0; i <= Nnbit; i++) {
-            Nv[i] = v[i];
-        }
+    if (Nm > m) {
+        if (Nm > cap) reserveWords(std::max(Nm, 2 * cap));     //рост с запасом, как у std::vector
+        std::fill(v + m, v + Nm, 0);
     }
-    
-    delete [] v;
-    v = Nv;
-    nbit = Nnbit;
     m = Nm;
+    nbit = Nnbit;
+    clearTail();
 }
 
-BoolVector BoolVector::operator=(const BoolVector &other){
+BoolVector& BoolVector::operator=(const BoolVector &other){
     if(this == &other) return *this;
-    delete [] v;
-    nbit = other.nbit;
+    if (other.m > cap) {
+        releaseHeap();
+        v = alloc.allocate(other.m);
+        cap = other.m;
+    }
     m = other.m;
-    v = new unsigned char[m]();
-    for(int i=0; i<m; i++){
-        v[i] = other.v[i];
+    nbit = other.nbit;
+    std::copy(other.v, other.v + m, v);
+    return *this;
+}
+
+//буфер из другого ресурса забрать нельзя - его слова копируются, как при обычном присваивании
+BoolVector& BoolVector::operator=(BoolVector &&other) noexcept{
+    if (this == &other) return *this;
+    if (other.v == other.local) {
+        std::copy(other.local, other.local + other.m, v);      //встроенный буфер влезает в любой наш
+    } else if (alloc != other.alloc) {
+        return *this = std::as_const(other);
+    } else {
+        releaseHeap();
+        v = other.v;
+        cap = other.cap;
+        other.v = other.local;
+        other.cap = inlineWords;
     }
+    m = other.m;
+    nbit = other.nbit;
+    other.nbit = 0;
+    other.m = 0;
     return *this;
 }
 
 bool BoolVector::operator==(const BoolVector &other) const{
     if(nbit != other.nbit) return false;
-    for(int i=0; i<m; i++){
-        if(v[i] != other.v[i]) return false;
-    }
-    return true;
+    return bitKernels().equalWords(v, other.v, m);
 }
 
-BoolVector BoolVector::operator|(const BoolVector &other) const{
-    BoolVector res(std::max(nbit, other.nbit));
-    int minM = std::min(m, other.m);
-    for(int i=0; i<minM; i++){
-        res.v[i] = v[i] | other.v[i];
-    }
-    if(m > other.m) {
-        for(int i = minM; i < m; i++) {
-            res.v[i] = v[i];
-        }
-    } else {
-        for(int i = minM; i < other.m; i++) {
-            res.v[i] = other.v[i];
-        }
-    }
-    
-    return res;
+BoolVector& BoolVector::operator|=(const BoolVector &other) {
+    if (other.nbit > nbit) resizeA(other.nbit);
+    bitKernels().orWords(v, other.v, other.m);
+    return *this;
 }
 
-BoolVector BoolVector::operator&(const BoolVector &other) const{
-    BoolVector res(std::max(nbit, other.nbit));
-    int minM = std::min(m, other.m);
-    for(int i=0; i<minM; i++){
-        res.v[i] = v[i] & other.v[i];
-    }
-    return res;
+BoolVector& BoolVector::andNot(const BoolVector &other) {
+    bitKernels().andNotWords(v, other.v, std::min(m, other.m));
+    return *this;
 }
 
-BoolVector BoolVector::operator~() const{
-    BoolVector res(nbit);
-    for(int i=0; i<m; i++){
-        res.v[i] = ~v[i];
-    }
-    return res;
+void BoolVector::Clear() {
+    std::fill(v, v + m, 0);
 }
 
 bool BoolVector::hasWeight() const {
-    for (int i = 0; i < nbit; i++) {
-        if ((*this)[i] == 1) {
-            return true;
-        }
-    }
-    return false;
+    return bitKernels().anyWords(v, m);
 }
 
 bool BoolVector::hasPrev() const {
-    for (int i = 1; i < nbit; i++) {
-        if ((*this)[i] == 1) {
-            return true;
+    return getLink() != -1;
+}
+
+//первый единичный бит, начиная с индекса 1 (индекс 0 - null)
+int BoolVector::getLink() const {
+    for (int i = 0; i < m; i++) {
+        std::uint64_t w = (i == 0) ? (v[0] & ~std::uint64_t(1)) : v[i];
+        if (w != 0) {
+            return i * 64 + std::countr_zero(w);
         }
     }
-    return false;
+    return -1;
 }
 
-int BoolVector::getLink() {
-    for (int i = 1; i < nbit; i++) {
-        if ((*this)[i] == 1) {
-            return i;
+int BoolVector::getLinkZeroIncluded() const {
+    for (int i = 0; i < m; i++) {
+        if (v[i] != 0) {
+            return i * 64 + std::countr_zero(v[i]);
         }
     }
     return -1;
 }
 
-int BoolVector::getLinkZeroIncluded() {
-    for (int i = 0; i < nbit; i++) {
-        if ((*this)[i] == 1) {
-            return i;
+//последний единичный бит, начиная с индекса 1
+int BoolVector::getLastLink() const {
+    for (int i = m - 1; i >= 0; i--) {
+        std::uint64_t w = (i == 0) ? (v[0] & ~std::uint64_t(1)) : v[i];
+        if (w != 0) {
+            return i * 64 + 63 - std::countl_zero(w);
         }
     }
     return -1;
 }
 
-int BoolVector::getWeight()  {
+int BoolVector::getWeight() const {
     int c = 0;
-    for (int i = 0; i < nbit; i++) {
-        if ((*this)[i] == 1) {
-            c++;
-        }
+    for (int i = 0; i < m; i++) {
+        c += std::popcount(v[i]);
     }
     return c;
 }
 
 std::ostream& operator << (std::ostream &os, const BoolVector &vec) {
-    for(int j=0;j<vec.m*8;j++){
+    for(int j=0;j<(vec.nbit+7)/8*8;j++){         //выводим с точностью до байта
         os << vec[j];
     }
     return os;
@@ -408,29 +725,1233 @@ std::istream& operator >> (std::istream &is, BoolVector &vec) {
     return is;
 }
 
+//Отметка "у хранилища была копия". Копирование отмечает и копию, и оригинал; пока копий не было,
+//запись не проверяет, общий ли кусок строк, - куски заведомо свои
+class CopyMark {
+private:
+    mutable bool copied = false;
+    
+public:
+    CopyMark() = default;
+    CopyMark(const CopyMark &other) : copied(true) {
+        other.copied = true;
+    }
+    CopyMark(CopyMark &&) noexcept = default;
+    CopyMark& operator = (const CopyMark &other) {
+        copied = other.copied = true;
+        return *this;
+    }
+    CopyMark& operator = (CopyMark &&) noexcept = default;
+    
+    explicit operator bool() const {
+        return copied;
+    }
+};
+
+//Массив строк, разбитый на куски по chunkRows строк. Куски общие для копий массива (копия
+//копирует только указатели на них), а перед изменением строки ее кусок копируется, если на него
+//ссылается кто-то еще (copy-on-write). Поэтому копия кнф не копирует строки, а изменение
+//копирует только кусок с измененной строкой. Чтение - через operator[], запись - через edit.
+template<class T>
+class SharedChunks {
+private:
+    static constexpr int chunkShift = 6;
+    static constexpr int chunkRows = 1 << chunkShift;
+    using Chunk = std::pmr::vector<T>;  //все куски, кроме последнего, - ровно по chunkRows строк
+
+    std::pmr::vector<std::shared_ptr<Chunk>> chunks;
+    int n;
+    CopyMark copied;
+    
+    template<class... Args>
+    std::shared_ptr<Chunk> makeChunk(Args&&... args) const {
+        return std::allocate_shared<Chunk>(std::pmr::polymorphic_allocator<Chunk>(chunks.get_allocator()),
+                                           std::forward<Args>(args)...);
+    }
+
+    Chunk& own(int c) {
+        std::shared_ptr<Chunk> &chunk = chunks[c];
+        if (copied && chunk.use_count() > 1) chunk = makeChunk(*chunk);
+        return *chunk;
+    }
+
+public:
+    SharedChunks(int size = 0, std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : chunks(memory), n(0) {
+        resize(size);
+    }
+    //копия pmr-вектора по умолчанию берет ресурс по умолчанию - указатели на куски копии остаются в ресурсе оригинала
+    SharedChunks(const SharedChunks &other)
+        : chunks(other.chunks, other.chunks.get_allocator()), n(other.n), copied(other.copied) {}
+    SharedChunks(SharedChunks &&) noexcept = default;
+    SharedChunks& operator = (const SharedChunks &) = default;
+    SharedChunks& operator = (SharedChunks &&) = default;
+
+    const T& operator[](int i) const {
+        return (*chunks[i >> chunkShift])[i & (chunkRows - 1)];
+    }
+    T& edit(int i) {
+        return own(i >> chunkShift)[i & (chunkRows - 1)];
+    }
+    
+    //f(строка) для всех строк, где pred(строка); копируются только куски с такими строками
+    template<class P, class F>
+    void editIf(P &&pred, F &&f) {
+        for (int c = 0; c < (int)chunks.size(); c++) {
+            const Chunk &chunk = *chunks[c];
+            int size = (int)chunk.size();
+            int k = 0;
+            while (k < size && !pred(chunk[k])) k++;
+            if (k == size) continue;
+            Chunk &mine = own(c);
+            for (; k < size; k++) {
+                if (pred(mine[k])) f(mine[k]);
+            }
+        }
+    }
+
+    int size() const {
+        return n;
+    }
+    int capacity() const {
+        if (chunks.empty()) return 0;
+        return ((int)chunks.size() - 1) * chunkRows + (int)chunks.back()->capacity();
+    }
+
+    //новые строки - T(); при уменьшении лишние строки пропадают
+    void resize(int size) {
+        int nChunks = (size + chunkRows - 1) >> chunkShift;
+        if (size < n) {
+            chunks.resize(nChunks);
+            if (size % chunkRows != 0) own(nChunks - 1).resize(size % chunkRows);
+        } else if (size > n) {
+            if (n % chunkRows != 0) {
+                own((int)chunks.size() - 1).resize(std::min(chunkRows, size - (n >> chunkShift) * chunkRows));
+            }
+            while ((int)chunks.size() < nChunks) {
+                int rows = std::min(chunkRows, size - (int)chunks.size() * chunkRows);
+                chunks.push_back(makeChunk(rows));
+            }
+        }
+        n = size;
+    }
+
+    void shrinkToFit() {
+        chunks.shrink_to_fit();
+        if (!chunks.empty() && chunks.back()->capacity() > chunks.back()->size()) own((int)chunks.size() - 1).shrink_to_fit();
+    }
+};
+
+//Строки отношения neg, лежащие непрерывными блоками памяти по blockRows строк:
+//строка i занимает stride слов в блоке i / blockRows. Блоки выровнены по 64 байтам,
+//stride - 1, 2 или 4 слова для узких компонент и кратен 8 словам (строке кэша) для широких,
+//поэтому строка не пересекает лишних строк кэша, а проходы по строкам идут по памяти подряд.
+//Блоки общие для копий матрицы и копируются перед изменением строки, как в SharedChunks.
+//Логическая длина каждой строки (как nbit у BoolVector) хранится отдельно в nbits.
+//Строку отдает withRow, через IncomingRows код кнф пишет neg[i].Set1(j) как и раньше.
+//Емкость по строкам (capRows) растет удвоением до blockRows, а дальше целыми блоками без переноса
+//строк, по столбцам (stride) - удвоением; при удалении узлов не уменьшается - только явным shrinkToFit. Расширение всех строк (widenRows) лишь
+//поднимает minBits, а длина строки доводится до него при обращении к ней.
+class BitMatrix {
+private:
+    static constexpr std::size_t alignment = 64;
+    static constexpr int blockShift = 6;
+    static constexpr int blockRows = 1 << blockShift;
+    using Block = std::shared_ptr<std::uint64_t>;
+    
+    std::pmr::memory_resource *memory;  //ресурс для блоков
+    std::pmr::vector<Block> blocks;     //пока capRows < blockRows - один блок из capRows строк
+    int nRows;
+    int capRows;
+    int stride;                         //слов на строку
+    int minBits;                        //ни одна строка не короче minBits
+    mutable std::pmr::vector<int> nbits;
+    CopyMark copied;
+    
+    static int strideFor(int nbit) {
+        int words = (nbit + 63) / 64;
+        if (words <= 1) return 1;
+        if (words <= 2) return 2;
+        if (words <= 4) return 4;
+        return (words + 7) / 8 * 8;
+    }
+    
+    Block allocate(int rows, int words) const {
+        std::size_t n = (std::size_t)rows * words;
+        std::uint64_t *p = static_cast<std::uint64_t*>(memory->allocate(n * sizeof(std::uint64_t), alignment));
+        std::fill(p, p + n, 0);
+        std::pmr::memory_resource *res = memory;
+        return Block(p, [res, n](std::uint64_t *q) { res->deallocate(q, n * sizeof(std::uint64_t), alignment); },
+                     std::pmr::polymorphic_allocator<>(memory));
+    }
+    
+    const std::uint64_t* rowData(int i) const {
+        return blocks[i >> blockShift].get() + (std::size_t)(i & (blockRows - 1)) * stride;
+    }
+    //строка для записи: блок, который делят с другой копией, сначала копируется
+    std::uint64_t* ownRow(int i) {
+        Block &block = blocks[i >> blockShift];
+        if (copied && block.use_count() > 1) {
+            int rows = std::min(capRows, blockRows);
+            Block copy = allocate(rows, stride);
+            std::copy(block.get(), block.get() + (std::size_t)rows * stride, copy.get());
+            block = std::move(copy);
+        }
+        return block.get() + (std::size_t)(i & (blockRows - 1)) * stride;
+    }
+    
+    //переносит строки в новые блоки: всего newCap строк по newStride слов
+    void relocate(int newCap, int newStride) {
+        if (newCap > blockRows) newCap = (newCap + blockRows - 1) / blockRows * blockRows;
+        std::pmr::vector<Block> Nblocks(memory);
+        for (int first = 0; first < newCap; first += blockRows) {
+            Nblocks.push_back(allocate(std::min(newCap, blockRows), newStride));
+        }
+        int keep = std::min(stride, newStride);
+        for (int i = 0; i < nRows; i++) {
+            const std::uint64_t *row = rowData(i);
+            std::copy(row, row + keep,
+                      Nblocks[i >> blockShift].get() + (std::size_t)(i & (blockRows - 1)) * newStride);
+        }
+        blocks = std::move(Nblocks);
+        capRows = newCap;
+        stride = newStride;
+    }
+    
+    int& rowBits(int i) const {
+        if (nbits[i] < minBits) nbits[i] = minBits;
+        return nbits[i];
+    }
+    
+    template<bool Const, class W, class B, class F>
+    decltype(auto) withStride(W *words, B *bits, F &f) const {
+        switch (stride) {
+            case 1: return f(BasicRow<Const, 1>(words, bits, 1));
+            case 2: return f(BasicRow<Const, 2>(words, bits, 2));
+            case 4: return f(BasicRow<Const, 4>(words, bits, 4));
+            default: return f(BasicRow<Const>(words, bits, stride));
+        }
+    }
+    
+    //обнуляет в строке i биты, начиная с from
+    void clearFrom(int i, int from) {
+        auto keepMask = [&](int w) {
+            int lo = w * 64;
+            return lo >= from ? std::uint64_t(0) : (std::uint64_t(1) << (from - lo)) - 1;
+        };
+        const std::uint64_t *words = rowData(i);
+        int first = from / 64;
+        if (first >= stride) return;
+        bool changes = (words[first] & ~keepMask(first)) != 0 ||
+                       bitKernels().anyWords(words + first + 1, stride - first - 1);
+        if (!changes) return;                        //строку не трогаем, чтобы не копировать ее блок
+        std::uint64_t *row = ownRow(i);
+        for (int w = from / 64; w < stride; w++) {
+            row[w] &= keepMask(w);
+        }
+    }
+    
+public:
+    //Строка матрицы. Words > 0 - ширина строки в словах, известная при компиляции:
+    //тогда все циклы по словам имеют постоянную длину и разворачиваются компилятором
+    template<bool Const, int Words = 0>
+    class BasicRow {
+    private:
+        using Word = std::conditional_t<Const, const std::uint64_t, std::uint64_t>;
+        using Bits = std::conditional_t<Const, const int, int>;
+        
+        Word *v;
+        Bits *nbit;
+        int m;                          //слов в строке (stride)
+        
+        int words() const {
+            if constexpr (Words > 0) return Words;
+            else return m;
+        }
+        
+    public:
+        BasicRow(Word *words, Bits *bits, int stride) : v(words), nbit(bits), m(stride) {}
+        BasicRow(const BasicRow &) = default;
+        BasicRow& operator = (const BasicRow &) = delete;
+        
+        void Set1(int index) const {
+            if (index >= *nbit) *nbit = index + 1;
+            v[index/64] |= std::uint64_t(1) << (index%64);
+        }
+        void Set0(int index) const {
+            if (index >= *nbit) return;
+            v[index/64] &= ~(std::uint64_t(1) << (index%64));
+        }
+        int operator[](int index) const {
+            if (index >= *nbit) return 0;
+            return (v[index/64] >> (index%64)) & 1;
+        }
+        void Clear() const {
+            std::fill(v, v + words(), 0);
+        }
+        
+        int bitCount() const {
+            return *nbit;
+        }
+        
+        bool hasWeight() const {
+            if constexpr (Words == 0) {
+                return bitKernels().anyWords(v, m);             //широкие строки - ядром
+            } else {
+                for (int i = 0; i < Words; i++) {
+                    if (v[i] != 0) return true;
+                }
+                return false;
+            }
+        }
+        bool hasPrev() const {
+            return getLink() != -1;
+        }
+        int getLink() const {
+            for (int i = 0; i < words(); i++) {
+                std::uint64_t w = (i == 0) ? (v[0] & ~std::uint64_t(1)) : v[i];
+                if (w != 0) return i * 64 + std::countr_zero(w);
+            }
+            return -1;
+        }
+        int getLinkZeroIncluded() const {
+            for (int i = 0; i < words(); i++) {
+                if (v[i] != 0) return i * 64 + std::countr_zero(v[i]);
+            }
+            return -1;
+        }
+        int getLastLink() const {
+            for (int i = words(); i-- > 0;) {
+                std::uint64_t w = (i == 0) ? (v[0] & ~std::uint64_t(1)) : v[i];
+                if (w != 0) return i * 64 + 63 - std::countl_zero(w);
+            }
+            return -1;
+        }
+        int getWeight() const {
+            int c = 0;
+            for (int i = 0; i < words(); i++) c += std::popcount(v[i]);
+            return c;
+        }
+        
+        template<class F>
+        void forEachSetBit(F &&f) const {
+            for (int i = 0; i < words(); i++) {
+                for (std::uint64_t w = v[i]; w != 0; w &= w - 1) {
+                    f(i * 64 + std::countr_zero(w));
+                }
+            }
+        }
+        
+        friend std::ostream& operator << (std::ostream &os, const BasicRow &row) {
+            for (int j = 0; j < (*row.nbit + 7) / 8 * 8; j++) {
+                os << row[j];
+            }
+            return os;
+        }
+    };
+    
+    BitMatrix(std::pmr::memory_resource *res = std::pmr::get_default_resource())
+        : memory(res), blocks(res), nRows(1), capRows(1), stride(1), minBits(1), nbits(1, 1, res) {
+        blocks.push_back(allocate(1, 1));
+    }
+    //копия делит блоки с оригиналом, а свои массивы и будущие блоки берет из его же ресурса
+    BitMatrix(const BitMatrix &other)
+        : memory(other.memory), blocks(other.blocks, other.memory), nRows(other.nRows), capRows(other.capRows),
+          stride(other.stride), minBits(other.minBits), nbits(other.nbits, other.memory), copied(other.copied) {}
+    BitMatrix(BitMatrix &&) noexcept = default;
+    BitMatrix& operator = (const BitMatrix &) = default;
+    BitMatrix& operator = (BitMatrix &&) = default;
+    
+    //вызывает f(строка i). Строки узких матриц (stride 1, 2 или 4 слова) передаются с шириной
+    //в параметре шаблона, так что запросы к ним идут без циклов по stride, широкие - с шириной stride
+    template<class F>
+    decltype(auto) withRow(int i, F &&f) {
+        return withStride<false>(ownRow(i), &rowBits(i), f);
+    }
+    template<class F>
+    decltype(auto) withRow(int i, F &&f) const {
+        return withStride<true>(rowData(i), &rowBits(i), f);
+    }
+    
+    int size() const {
+        return nRows;
+    }
+    int capacity() const {
+        return capRows;
+    }
+    
+    //nRows строк, ширина хранения не меньше maxBits; новые строки - длины 1, как BoolVector().
+    //При нехватке stride как минимум удваивается, строки добавляются как описано выше
+    void reshape(int Nrows, int maxBits) {
+        int Nstride = strideFor(maxBits);
+        if (Nstride > stride || (Nrows > capRows && capRows < blockRows)) {
+            relocate(Nrows > capRows ? std::max(Nrows, 2 * capRows) : capRows,
+                     Nstride > stride ? std::max(Nstride, 2 * stride) : stride);
+        }
+        while (capRows < Nrows) {                    //дальше растем целыми блоками, строки не переносятся
+            blocks.push_back(allocate(blockRows, stride));
+            capRows += blockRows;
+        }
+        for (int i = nRows; i < Nrows; i++) {
+            if (bitKernels().anyWords(rowData(i), stride)) {
+                std::uint64_t *words = ownRow(i);
+                std::fill(words, words + stride, 0);
+            }
+        }
+        nRows = Nrows;
+        nbits.resize(Nrows, 1);
+    }
+    
+    //расширяет до nbits все строки, которые короче
+    void widenRows(int nbit) {
+        minBits = std::max(minBits, nbit);
+    }
+    
+    //обрезает все строки до keepBits значимых бит и выставляет им длину nbits
+    void truncateRows(int keepBits, int nbit) {
+        for (int i = 0; i < nRows; i++) {
+            clearFrom(i, std::min(keepBits, nbit));
+            nbits[i] = nbit;
+        }
+        minBits = nbit;
+    }
+    
+    //обнуляет столбец j во всех строках: по одному слову на строку, копируются только блоки с этим битом
+    void clearColumn(int j) {
+        std::uint64_t bit = std::uint64_t(1) << (j % 64);
+        for (int first = 0; first < nRows; first += blockRows) {
+            const std::uint64_t *word = blocks[first >> blockShift].get() + j / 64;
+            int rows = std::min(blockRows, nRows - first);
+            for (int k = 0; k < rows; k++, word += stride) {
+                if (*word & bit) ownRow(first + k)[j / 64] &= ~bit;
+            }
+        }
+    }
+    
+    //уплотнение после удалений: rank[k] - число живых слотов среди первых k.
+    //Живая строка i переезжает в строку rank[i], ее бит j - в бит rank[j], удаленные пропадают
+    void remapSlots(std::span<const int> rank) {
+        int last = (int)rank.size() - 1;
+        auto live = [&](int j) { return j < last && rank[j + 1] > rank[j]; };
+        std::pmr::vector<std::uint64_t> tmp(stride, memory);
+        for (int i = 0; i < nRows; i++) {
+            std::uint64_t *row = ownRow(i);
+            if (!live(i)) {
+                std::fill(row, row + stride, 0);
+                continue;
+            }
+            int len = rowBits(i);
+            std::copy(row, row + stride, tmp.begin());
+            std::fill(row, row + stride, 0);
+            std::uint64_t *dst = ownRow(rank[i]);
+            for (int w = 0; w < stride; w++) {
+                for (std::uint64_t bits = tmp[w]; bits != 0; bits &= bits - 1) {
+                    int j = w * 64 + std::countr_zero(bits);
+                    if (live(j)) dst[rank[j] / 64] |= std::uint64_t(1) << (rank[j] % 64);
+                }
+            }
+            nbits[rank[i]] = rank[std::min(len, last)];
+        }
+        nRows = rank[std::min(nRows, last)];
+        nbits.resize(nRows);
+        minBits = rank[std::min(minBits, last)];
+    }
+    
+    //возвращает лишнюю емкость: строк ровно nRows, stride - по самой длинной строке
+    void shrinkToFit() {
+        int maxBits = minBits;
+        for (int i = 0; i < nRows; i++) maxBits = std::max(maxBits, nbits[i]);
+        relocate(nRows, strideFor(maxBits));
+    }
+};
+
+//Входящие связи в виде списков: для каждой строки - отсортированные индексы единичных бит.
+//Интерфейс тот же, что у BitMatrix, но память O(узлов + связей) вместо O(узлов^2),
+//поэтому так можно держать компоненты из сотен тысяч объектов.
+class SparseRows {
+private:
+    SharedChunks<std::pmr::vector<int>> rows;
+    mutable std::pmr::vector<int> nbits;
+    int minBits;                        //ни одна строка не короче minBits, как в BitMatrix
+    
+    int& rowBits(int i) const {
+        if (nbits[i] < minBits) nbits[i] = minBits;
+        return nbits[i];
+    }
+    
+    //убирает из строки i индексы, начиная с from
+    void clearFrom(int i, int from) {
+        if (rows[i].empty() || rows[i].back() < from) return;
+        std::pmr::vector<int> &row = rows.edit(i);
+        row.erase(std::lower_bound(row.begin(), row.end(), from), row.end());
+    }
+    
+public:
+    template<bool Const>
+    class BasicRow {
+    private:
+        using List = std::conditional_t<Const, const std::pmr::vector<int>, std::pmr::vector<int>>;
+        using Bits = std::conditional_t<Const, const int, int>;
+        
+        List *bits;
+        Bits *nbit;
+        
+    public:
+        BasicRow(List *list, Bits *len) : bits(list), nbit(len) {}
+        BasicRow(const BasicRow &) = default;
+        BasicRow& operator = (const BasicRow &) = delete;
+        
+        void Set1(int index) const {
+            if (index >= *nbit) *nbit = index + 1;
+            auto it = std::lower_bound(bits->begin(), bits->end(), index);
+            if (it == bits->end() || *it != index) bits->insert(it, index);
+        }
+        void Set0(int index) const {
+            auto it = std::lower_bound(bits->begin(), bits->end(), index);
+            if (it != bits->end() && *it == index) bits->erase(it);
+        }
+        int operator[](int index) const {
+            return std::binary_search(bits->begin(), bits->end(), index);
+        }
+        void Clear() const {
+            bits->clear();
+        }
+        
+        int bitCount() const {
+            return *nbit;
+        }
+        bool hasWeight() const {
+            return !bits->empty();
+        }
+        int getWeight() const {
+            return (int)bits->size();
+        }
+        
+        template<class F>
+        void forEachSetBit(F &&f) const {
+            for (int j : *bits) f(j);
+        }
+        
+        friend std::ostream& operator << (std::ostream &os, const BasicRow &row) {
+            auto it = row.bits->begin();
+            for (int j = 0; j < (*row.nbit + 7) / 8 * 8; j++) {
+                bool set = it != row.bits->end() && *it == j;
+                if (set) ++it;
+                os << set;
+            }
+            return os;
+        }
+    };
+    
+    using Row = BasicRow<false>;
+    using ConstRow = BasicRow<true>;
+    
+    SparseRows(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : rows(1, memory), nbits(1, 1, memory), minBits(1) {}
+    SparseRows(const SparseRows &other)
+        : rows(other.rows), nbits(other.nbits, other.nbits.get_allocator()), minBits(other.minBits) {}
+    SparseRows(SparseRows &&) noexcept = default;
+    SparseRows& operator = (const SparseRows &) = default;
+    SparseRows& operator = (SparseRows &&) = default;
+    
+    Row operator[](int i) {
+        return Row(&rows.edit(i), &rowBits(i));
+    }
+    ConstRow operator[](int i) const {
+        return ConstRow(&rows[i], &rowBits(i));
+    }
+    template<class F>
+    decltype(auto) withRow(int i, F &&f) {
+        return f((*this)[i]);
+    }
+    template<class F>
+    decltype(auto) withRow(int i, F &&f) const {
+        return f((*this)[i]);
+    }
+    
+    int size() const {
+        return rows.size();
+    }
+    int capacity() const {
+        return rows.capacity();
+    }
+    
+    void reshape(int nRows, int) {
+        rows.resize(nRows);
+        nbits.resize(nRows, 1);
+    }
+    
+    void widenRows(int nbit) {
+        minBits = std::max(minBits, nbit);
+    }
+    
+    void truncateRows(int keepBits, int nbit) {
+        for (int i = 0; i < rows.size(); i++) {
+            clearFrom(i, std::min(keepBits, nbit));
+            nbits[i] = nbit;
+        }
+        minBits = nbit;
+    }
+    
+    void clearColumn(int j) {
+        rows.editIf([&](const std::pmr::vector<int> &row) { return std::binary_search(row.begin(), row.end(), j); },
+                    [&](std::pmr::vector<int> &row) { row.erase(std::lower_bound(row.begin(), row.end(), j)); });
+    }
+    
+    //уплотнение после удалений, как у BitMatrix
+    void remapSlots(std::span<const int> rank) {
+        int last = (int)rank.size() - 1;
+        auto live = [&](int j) { return j < last && rank[j + 1] > rank[j]; };
+        int n = rows.size();
+        for (int i = 0; i < n; i++) {
+            if (!live(i)) continue;
+            int len = rowBits(i);
+            std::pmr::vector<int> &row = rows.edit(i);
+            int k = 0;
+            for (int j : row) {
+                if (live(j)) row[k++] = rank[j];
+            }
+            row.resize(k);
+            if (rank[i] != i) rows.edit(rank[i]) = std::move(row);
+            nbits[rank[i]] = rank[std::min(len, last)];
+        }
+        n = rank[std::min(n, last)];
+        rows.resize(n);
+        nbits.resize(n);
+        minBits = rank[std::min(minBits, last)];
+    }
+    
+    void shrinkToFit() {
+        rows.shrinkToFit();
+        nbits.shrink_to_fit();
+    }
+};
+
+//Входящие связи кнф (neg) в одном из двух представлений: плотная матрица BitMatrix
+//или списки SparseRows. Представление выбирается при запуске (setSparse) для всех
+//создаваемых после этого кнф; код кнф работает с ним через те же neg[i].Set1(j) и т.д.
+class IncomingRows {
+private:
+    using Rows = std::variant<BitMatrix, SparseRows>;
+    Rows rows;
+    
+    inline static bool sparseByDefault = false;
+    
+    template<class R, class F>
+    static decltype(auto) visitRows(R &r, F &&f) {
+        if (r.index() == 0) return f(*std::get_if<0>(&r));
+        return f(*std::get_if<1>(&r));
+    }
+    
+public:
+    static void setSparse(bool sparse) {
+        sparseByDefault = sparse;
+    }
+    
+    template<class Set>
+    class BasicRowRef {
+    private:
+        Set *set;
+        int i;
+        
+        template<class F>
+        decltype(auto) apply(F &&f) const {
+            return visitRows(set->rows, [&](auto &r) -> decltype(auto) {
+                return r.withRow(i, f);
+            });
+        }
+        //чтение идет через константную строку, чтобы не копировать общий с другой кнф кусок строк
+        template<class F>
+        decltype(auto) read(F &&f) const {
+            return visitRows(std::as_const(set->rows), [&](const auto &r) -> decltype(auto) {
+                return r.withRow(i, f);
+            });
+        }
+        
+    public:
+        BasicRowRef(Set *s, int ind) : set(s), i(ind) {}
+        
+        int operator[](int j) const { return read([&](const auto &row) { return row[j]; }); }
+        bool hasWeight() const { return read([](const auto &row) { return row.hasWeight(); }); }
+        int getWeight() const { return read([](const auto &row) { return row.getWeight(); }); }
+        int bitCount() const { return read([](const auto &row) { return row.bitCount(); }); }
+        
+        template<class F>
+        void forEachSetBit(F &&f) const { read([&](const auto &row) { row.forEachSetBit(f); }); }
+        
+        void Set1(int j) const { apply([&](const auto &row) { row.Set1(j); }); }
+        void Set0(int j) const { apply([&](const auto &row) { row.Set0(j); }); }
+        void Clear() const { apply([](const auto &row) { row.Clear(); }); }
+        
+        friend std::ostream& operator << (std::ostream &os, const BasicRowRef &ref) {
+            ref.read([&](const auto &row) { os << row; });
+            return os;
+        }
+    };
+    
+    using RowRef = BasicRowRef<IncomingRows>;
+    using ConstRowRef = BasicRowRef<const IncomingRows>;
+    
+    IncomingRows(std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+        : rows(sparseByDefault ? Rows(std::in_place_index<1>, memory) : Rows(std::in_place_index<0>, memory)) {}
+    
+    RowRef operator[](int i) {
+        return RowRef(this, i);
+    }
+    ConstRowRef operator[](int i) const {
+        return ConstRowRef(this, i);
+    }
+    
+    int size() const {
+        return visitRows(rows, [](const auto &r) { return r.size(); });
+    }
+    int capacity() const {
+        return visitRows(rows, [](const auto &r) { return r.capacity(); });
+    }
+    void reshape(int nRows, int maxBits) {
+        visitRows(rows, [&](auto &r) { r.reshape(nRows, maxBits); });
+    }
+    void widenRows(int nbit) {
+        visitRows(rows, [&](auto &r) { r.widenRows(nbit); });
+    }
+    void truncateRows(int keepBits, int nbit) {
+        visitRows(rows, [&](auto &r) { r.truncateRows(keepBits, nbit); });
+    }
+    void clearColumn(int j) {
+        visitRows(rows, [&](auto &r) { r.clearColumn(j); });
+    }
+    void remapSlots(std::span<const int> rank) {
+        visitRows(rows, [&](auto &r) { r.remapSlots(rank); });
+    }
+    void shrinkToFit() {
+        visitRows(rows, [](auto &r) { r.shrinkToFit(); });
+    }
+};
+
+//Строка связи-указателя (pos_type1 / pos_type2). Поле next или prev указывает ровно
+//на один объект, поэтому строка почти всегда содержит не больше одной единицы:
+//тогда хранится только ее индекс (one) и все запросы выполняются за O(1).
+//Если в строку ставится второй бит (фиктивные связи из null, строка 0),
+//она переходит на обычный BoolVector (many) и остается на нем: Clear() только обнуляет биты,
+//чтобы строка 0, которую фиктивные связи то заполняют, то очищают, не выделяла память заново.
+class PtrRow {
+private:
+    //битовый вектор строки берется из ресурса строки (им ее создает набор строк), а не из кучи,
+    //и возвращается туда же - в ресурс, из которого выделены его слова
+    struct ManyDeleter {
+        void operator()(BoolVector *bits) const {
+            std::pmr::polymorphic_allocator<BoolVector>(bits->get_allocator().resource()).delete_object(bits);
+        }
+    };
+    using ManyPtr = std::unique_ptr<BoolVector, ManyDeleter>;
+    
+    template<class... Args>
+    ManyPtr makeMany(Args&&... args) const {
+        return ManyPtr(allocator_type(alloc).new_object<BoolVector>(std::forward<Args>(args)...));
+    }
+    
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<>;
+    
+private:
+    int one;                            //индекс единичного бита, -1 - строка пустая
+    int nbit;                           //логическая длина строки, как у BoolVector
+    allocator_type alloc;               //откуда берется many
+    ManyPtr many;                       //битовый вектор, если единиц больше одной
+    
+public:
+    PtrRow(int nn = 1, const allocator_type &a = {}) : one(-1), nbit(nn), alloc(a) {}
+    explicit PtrRow(const allocator_type &a) : PtrRow(1, a) {}
+    PtrRow(const PtrRow &other, const allocator_type &a = {})
+        : one(other.one), nbit(other.nbit), alloc(a),
+          many(other.many ? makeMany(*other.many) : nullptr) {}
+    PtrRow(PtrRow &&other) noexcept = default;
+    PtrRow(PtrRow &&other, const allocator_type &a)
+        : one(other.one), nbit(other.nbit), alloc(a),
+          many(a == other.alloc ? std::move(other.many) : other.many ? makeMany(*other.many) : nullptr) {}
+    
+    PtrRow& operator = (const PtrRow &other) {
+        if (this == &other) return *this;
+        one = other.one;
+        nbit = other.nbit;
+        if (other.many) {
+            if (many) *many = *other.many;
+            else many = makeMany(*other.many);
+        } else {
+            many.reset();
+        }
+        return *this;
+    }
+    //аллокатор строки не переназначается (polymorphic_allocator не присваивается): many забирается
+    //у other, только если он выделен из того же ресурса, иначе копируется в свой
+    PtrRow& operator = (PtrRow &&other) noexcept {
+        if (this == &other) return *this;
+        if (alloc != other.alloc) return *this = other;
+        one = other.one;
+        nbit = other.nbit;
+        many = std::move(other.many);
+        return *this;
+    }
+    
+    void Set1(int index) {
+        if (index >= nbit) {
+            nbit = index + 1;
+            if (many) many->resizeA(nbit);
+        }
+        if (many) {
+            many->Set1(index);
+        } else if (one == -1 || one == index) {
+            one = index;
+        } else {                                     //второй бит - переходим на битовый вектор
+            many = makeMany(nbit);
+            many->Set1(one);
+            many->Set1(index);
+            one = -1;
+        }
+    }
+    void Set0(int index) {
+        if (index >= nbit) return;
+        if (many) many->Set0(index);
+        else if (one == index) one = -1;
+    }
+    int operator[](int index) const {
+        if (index >= nbit) return 0;
+        if (many) return (*many)[index];
+        return one == index;
+    }
+    void Clear() {
+        one = -1;
+        if (many) many->Clear();
+    }
+    //объединение с целым вектором (строка null - связи во все переменные-указатели) идет словами,
+    //поэтому строка сразу переходит на битовый вектор
+    PtrRow& operator |= (const BoolVector &bits) {
+        int top = std::max(bits.getLastLink(), bits[0] == 1 ? 0 : -1) + 1;
+        if (top > nbit) resizeA(top);               //длина растет, как от Set1 каждого бита
+        if (!many) {
+            many = makeMany(nbit);
+            if (one != -1) many->Set1(one);
+            one = -1;
+        }
+        *many |= bits;
+        many->resizeA(nbit);                        //за top у bits только нули
+        return *this;
+    }
+    PtrRow& andNot(const BoolVector &bits) {
+        if (many) many->andNot(bits);
+        else if (one != -1 && bits[one] == 1) one = -1;
+        return *this;
+    }
+    void resizeA(int Nnbit) {
+        nbit = Nnbit;
+        if (many) many->resizeA(Nnbit);
+        else if (one >= Nnbit) one = -1;
+    }
+    
+    int bitCount() const {
+        return nbit;
+    }
+    bool hasWeight() const {
+        return many ? many->hasWeight() : one != -1;
+    }
+    bool hasPrev() const {
+        return getLink() != -1;
+    }
+    int getLink() const {
+        if (many) return many->getLink();
+        return one >= 1 ? one : -1;
+    }
+    int getLinkZeroIncluded() const {
+        return many ? many->getLinkZeroIncluded() : one;
+    }
+    int getLastLink() const {
+        return many ? many->getLastLink() : getLink();
+    }
+    int getWeight() const {
+        return many ? many->getWeight() : (one != -1);
+    }
+    
+    template<class F>
+    void forEachSetBit(F &&f) const {
+        if (many) many->forEachSetBit(f);
+        else if (one != -1) f(one);
+    }
+    
+    //уплотнение после удалений, как у BitMatrix
+    void remapSlots(std::span<const int> rank) {
+        int last = (int)rank.size() - 1;
+        auto live = [&](int j) { return j < last && rank[j + 1] > rank[j]; };
+        nbit = rank[std::min(nbit, last)];
+        if (many) {
+            BoolVector bits(nbit, many->get_allocator());
+            many->forEachSetBit([&](int j) {
+                if (live(j)) bits.Set1(rank[j]);
+            });
+            *many = std::move(bits);
+        } else if (one != -1) {
+            one = live(one) ? rank[one] : -1;
+        }
+    }
+    
+    //вывод строки длиной nbits (не меньше nbit): биты за nbit нулевые
+    void print(std::ostream &os, int nbits) const {
+        for (int j = 0; j < (nbits + 7) / 8 * 8; j++) {
+            os << (*this)[j];
+        }
+    }
+    
+    friend std::ostream& operator << (std::ostream &os, const PtrRow &row) {
+        row.print(os, row.nbit);
+        return os;
+    }
+};
+
+//Набор строк-указателей одного отношения; интерфейс тот же, что у BitMatrix и SparseRows
+//Как и в BitMatrix, widenRows только поднимает minBits, а строка доводится до него при изменении.
+//Строку отдает ссылка RowRef, как у IncomingRows: чтение идет через константную строку и не копирует
+//общий с другой кнф кусок строк, копирование и доводка до minBits - только при записи
+class PtrRowSet {
+private:
+    SharedChunks<PtrRow> rows;
+    int minBits;
+    
+    PtrRow& row(int i) {
+        PtrRow &r = rows.edit(i);
+        if (r.bitCount() < minBits) r.resizeA(minBits);
+        return r;
+    }
+    
+public:
+    template<class Set>
+    class BasicRowRef {
+    private:
+        Set *set;
+        int i;
+        
+        const PtrRow& get() const {
+            return std::as_const(set->rows)[i];
+        }
+        int width() const {
+            return std::max(get().bitCount(), set->minBits);
+        }
+        
+    public:
+        BasicRowRef(Set *s, int ind) : set(s), i(ind) {}
+        
+        int operator[](int j) const { return get()[j]; }
+        bool hasWeight() const { return get().hasWeight(); }
+        int getLink() const { return get().getLink(); }
+        int getLinkZeroIncluded() const { return get().getLinkZeroIncluded(); }
+        int getLastLink() const { return get().getLastLink(); }
+        int bitCount() const { return width(); }
+        
+        template<class F>
+        void forEachSetBit(F &&f) const { get().forEachSetBit(f); }
+        
+        void Set1(int j) const { set->row(i).Set1(j); }
+        void Set0(int j) const { set->row(i).Set0(j); }
+        void Clear() const { set->row(i).Clear(); }
+        void operator |= (const BoolVector &bits) const { set->row(i) |= bits; }
+        void andNot(const BoolVector &bits) const { set->row(i).andNot(bits); }
+        
+        //копирование строки: pos_type1[i] = pos_type1[j]
+        template<class Other>
+        const BasicRowRef& operator = (const BasicRowRef<Other> &src) const {
+            PtrRow &to = set->row(i);
+            to = src.get();
+            return *this;
+        }
+        const BasicRowRef& operator = (const BasicRowRef &src) const {
+            return operator =<Set>(src);
+        }
+        
+        //строка выводится длиной minBits, как если бы была доведена до нее
+        friend std::ostream& operator << (std::ostream &os, const BasicRowRef &ref) {
+            ref.get().print(os, ref.width());
+            return os;
+        }
+        
+        template<class> friend class BasicRowRef;
+    };
+    
+    using RowRef = BasicRowRef<PtrRowSet>;
+    using ConstRowRef = BasicRowRef<const PtrRowSet>;
+    
+    PtrRowSet(std::pmr::memory_resource *memory = std::pmr::get_default_resource()) : rows(1, memory), minBits(1) {}
+    
+    RowRef operator[](int i) {
+        return RowRef(this, i);
+    }
+    ConstRowRef operator[](int i) const {
+        return ConstRowRef(this, i);
+    }
+    
+    int size() const {
+        return rows.size();
+    }
+    
+    void reshape(int nRows, int) {
+        rows.resize(nRows);
+    }
+    
+    void widenRows(int nbits) {
+        minBits = std::max(minBits, nbits);
+    }
+    
+    void truncateRows(int keepBits, int nbits) {
+        for (int i = 0; i < rows.size(); i++) {
+            PtrRow &r = rows.edit(i);
+            r.resizeA(keepBits);
+            r.resizeA(nbits);
+        }
+        minBits = nbits;
+    }
+    
+    void clearColumn(int j) {
+        rows.editIf([&](const PtrRow &r) { return r[j] == 1; }, [&](PtrRow &r) { r.Set0(j); });
+    }
+    
+    void remapSlots(std::span<const int> rank) {
+        int last = (int)rank.size() - 1;
+        int n = rows.size();
+        for (int i = 0; i < n; i++) {
+            if (i >= last || rank[i + 1] == rank[i]) continue;
+            PtrRow &r = row(i);
+            r.remapSlots(rank);
+            if (rank[i] != i) rows.edit(rank[i]) = std::move(r);
+        }
+        rows.resize(rank[std::min(n, last)]);
+        minBits = rank[std::min(minBits, last)];
+    }
+    
+    void shrinkToFit() {
+        rows.shrinkToFit();
+    }
+};
+
+//Глобальная таблица имен: каждое имя переменной-указателя и участка памяти (N1, N2, ...)
+//из трассы получает 32-битный номер - символ. Кнф и обработка событий работают с символами,
+//строки нужны только при выводе.
+using Symbol = std::uint32_t;
+
+class SymbolTable {
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, Symbol> ids;
+    
+public:
+    static constexpr Symbol empty = 0;          //пустое имя, им помечаются удаленные слоты
+    
+    SymbolTable() {
+        intern("");
+    }
+    
+    Symbol intern(const std::string &name) {
+        auto [it, inserted] = ids.try_emplace(name, (Symbol)names.size());
+        if (inserted) names.push_back(name);
+        return it->second;
+    }
+    
+    const std::string& name(Symbol sym) const {
+        return names[sym];
+    }
+};
+
+static SymbolTable& symbols() {
+    static SymbolTable table;
+    return table;
+}
+
+//Индекс расположения имен списка компонент (CNFList): для каждого символа - номер компоненты
+//(CNF::getId), в которой он сейчас лежит, или -1. Слот внутри компоненты дает ее собственный nameToSlot.
+//Кнф, лежащие в списке, обновляют индекс сами при добавлении и удалении имен, поэтому он верен после
+//addPtrVar, addAlMem, point, merge, divide и deleteNode.
+class NameLocations {
+private:
+    std::vector<int> owner;             //символы плотные, так что хватает массива
+    
+public:
+    void place(Symbol name, int comp) {
+        if (name >= owner.size()) owner.resize(name + 1, -1);
+        owner[name] = comp;
+    }
+    //снимает имя с компоненты, если оно еще числится за ней (при переносе его уже перехватила другая)
+    void remove(Symbol name, int comp) {
+        if (name < owner.size() && owner[name] == comp) owner[name] = -1;
+    }
+    int ownerOf(Symbol name) const {
+        return name < owner.size() ? owner[name] : -1;
+    }
+};
+
+//Рабочие массивы обходов: разметки и разделения (labelComponents, divide, divideLocal, splitOff),
+//слияния (merge) и достижимости (updateRooted, reachable). Между операциями в них ничего не хранится, поэтому они общие для всех
+//кнф одного списка (CNFList) - у кнф только указатель. Емкость растет вместе с самой большой кнф
+//(CNF::reserveScratch), так что операции над устоявшимися кнф не выделяют память.
+//Операция кнф не вызывает операций другой кнф, пока держит эти массивы, - иначе общий набор был бы нельзя
+struct CNFScratch {
+    std::pmr::vector<unsigned> mark;                //метки обходов, сбрасываются сдвигом markBase
+    unsigned markBase = 0;
+    std::pmr::vector<int> walk;                     //стек и область обходов достижимости
+    std::pmr::vector<int> region;
+    std::pmr::vector<int> comp;                     //номер компоненты для каждого узла
+    std::pmr::vector<int> compSizes;
+    std::pmr::vector<int> forest;                   //объединение обходов в labelComponents и divideLocal
+    std::pmr::vector<int> rootToComp;
+    std::pmr::vector<int> compNodes;                //узлы компонент подряд, по компонентам (divide)
+    std::pmr::vector<int> compStart;
+    std::pmr::vector<std::pmr::vector<int>> queues; //узлы, посещенные каждым обходом divideLocal
+    std::pmr::vector<int> head;
+    std::pmr::vector<int> active;
+    std::pmr::vector<int> ends;
+    std::pmr::vector<int> part;
+    std::pmr::vector<int> newInds;
+    std::pmr::vector<int> newList;
+    std::pmr::vector<int> remap;                    //старый индекс -> новый при переносе узлов
+    std::pmr::vector<int> rank;                     //слот -> номер в порядке ключей (CNF::keyRanks) и обратно
+    std::pmr::vector<int> rankSlot;
+    std::pmr::vector<int> order;                    //узлы в порядке переноса (merge, splitOrder); не резервируется в reserveScratch -
+                                                    //takeNodes и splitOff растят кнф, пока читают его
+    std::pmr::vector<int> frontWords;               //ненулевые слова фронта reachable
+    std::pmr::vector<int> nextWords;
+    
+    explicit CNFScratch(std::pmr::memory_resource *res = std::pmr::get_default_resource())
+        : mark(res), walk(res), region(res), comp(res), compSizes(res), forest(res), rootToComp(res),
+          compNodes(res), compStart(res), queues(res), head(res), active(res), ends(res), part(res),
+          newInds(res), newList(res), remap(res), rank(res), rankSlot(res), order(res), frontWords(res), nextWords(res) {}
+    CNFScratch(const CNFScratch&) = delete;
+    CNFScratch& operator=(const CNFScratch&) = delete;
+    
+    //набор для кнф вне списка; живет до конца программы и берет память из кучи
+    static CNFScratch& shared() {
+        static CNFScratch scratch(std::pmr::new_delete_resource());
+        return scratch;
+    }
+};
+
 class CNF {
 private:
+    std::pmr::memory_resource *memory;    //откуда берут память строки кнф и кнф, отделяемые от нее
     BoolVector ptr_var;       //1 на идексе бита тех объектов, которые являются переменными-указателями
-    BoolVector *pos_type1;    //связь типа next
-    BoolVector *pos_type2;    //связь типа prev
-    BoolVector *neg;          //Входящие связи
-    std::vector<std::string> var_names;
+    PtrRowSet pos_type1;      //связь типа next
+    PtrRowSet pos_type2;      //связь типа prev
+    IncomingRows neg;         //Входящие связи
+    std::pmr::vector<Symbol> var_names;
+    std::pmr::unordered_map<Symbol, int> nameToSlot;     //индекс имен: имя -> слот в var_names
+    
+    //Удаленные узлы не перенумеровывают остальные: их слот обнуляется и помечается в dead,
+    //а вырезаются все такие слоты разом в compactSlots - перед выводом, перед divide/merge,
+    //где важен порядок индексов, или когда удаленных набирается больше 1/tombstoneShare слотов
+    static constexpr int tombstoneShare = 4;
+    BoolVector dead;
+    int nDead;
+    
+    int nVar;                 //число слотов, включая удаленные
+    //Порядок узлов кнф (в выводе, в нумерации компонент и переменных формулы) - порядок ключей, а не слотов.
+    //Новый узел получает следующий ключ, так что обычно они совпадают; расходятся они после слияния
+    //обменом (merge), где узлы меньшей кнф встают в конец слотов, но в начало порядка.
+    //keySlot[k] == -1 - узел с ключом k удален; compactSlots нумерует ключи заново подряд
+    std::pmr::vector<int> slotKey;
+    std::pmr::vector<int> keySlot;
+    inline static int nextId = 0;
+    //Номер компоненты для индекса имен и сам индекс списка, в котором лежит кнф (nullptr - вне списка).
+    //При перемещении кнф не меняются. Копия получает новый номер и ни в какой индекс не записана,
+    //так что ее изменения не трогают имена оригинала
+    struct Registration {
+        int id = nextId++;
+        NameLocations *locations = nullptr;
+        
+        Registration() = default;
+        Registration(const Registration &) {}
+        Registration(Registration &&) noexcept = default;
+        Registration& operator = (Registration &&) noexcept = default;
+    };
+    Registration reg;
+    
+    //Кнф "устоялась", если последняя полная разметка нашла одну компоненту без потерянных узлов.
+    //Тогда изменения связей только запоминаются, и divide проверяет разделение вокруг них (divideLocal),
+    //не обходя всю кнф. Любой случай, который так не разобрать, сбрасывает состояние до полной разметки.
+    bool settled;
+    int settledFields;                 //nFields, с которым считались незамкнутые узлы
+    std::pmr::vector<int> touched;     //строки, чьи исходящие связи менялись
+    std::pmr::vector<int> cutTargets;  //прежние цели этих связей и новые узлы - их достижимость перепроверяем
+    BoolVector openRows;               //узлы, у которых нет связи по какому-то из полей
+    int nOpen;
+    
+    //Достижимость от переменных-указателей поддерживается после каждой операции: по новым связям
+    //она распространяется вперед, а при разрыве перепроверяется только область за прежней целью
+    BoolVector rooted;                 //1 - до узла можно дойти от какой-то переменной-указателя
+    static constexpr int rescanShare = 16;  //прежних целей больше 1/rescanShare узлов - пересчитываем rooted целиком
+    std::pmr::vector<int> changedRows; //строки, измененные текущей операцией
+    std::pmr::vector<int> oldTargets;  //их цели до изменения
+    //linkedFrom[t] - узлы, чьи связи pos_type1/pos_type2 ведут в t. В отличие от neg, сюда попадают все
+    //связи, в том числе prev-связи, скопированные в переменную-указатель в point
+    SharedChunks<std::pmr::vector<int>> linkedFrom;
+    CNFScratch *scratch;               //рабочие массивы обходов, общие для кнф списка
     
-    int nVar;
-     
     void resizeB(int);
+    void reserveScratch(int);
+    void compact();
+    void eraseSlot(int, bool noteLinks = true);                  //удаление узла без перенумерации
+    void addName(Symbol);                                        //новое имя в конец var_names и в индекс имен
+    int compactSlots(int ind = 0);                               //вырезает удаленные слоты, возвращает новый индекс ind
+    void keyRanks(std::pmr::vector<int>&) const;                 //номер каждого живого слота в порядке ключей
+    template<class F>
+    void forEachLiveInOrder(F&&) const;                          //f(слот) для живых узлов в порядке ключей
+    template<class Row>
+    void printLive(const Row&) const;                            //вывод строки без бит удаленных слотов
+    
+    bool isOpen(int, int) const;                                 //нет связи по какому-то из полей
+    void settle(int);                                            //запоминает устоявшееся состояние после полной разметки
+    void unsettle();
+    void noteRowChange(int);                                     //вызывается перед изменением исходящих связей строки
+    void noteNewNode(int);
+    void updateOpenRows();
+    unsigned newMarks(int);
+    bool reachesFromPointer(int);
+    void addLinksFrom(int);
+    void dropLinksFrom(int);
+    void spreadRooted();
+    void unrootFrom(int);
+    void updateRooted();                                         //вызывается в конце операции, менявшей связи
+    void setFictiousBonds();
+    void setNullBonds(bool);
+    void splitOrder(std::span<const int>, std::pmr::vector<int>&);      //порядок переноса отделяемой части
+    void splitOff(CNF&, std::span<const int>, std::pmr::vector<int>&);   //перенос узлов в новую кнф
+    void takeNodes(CNF&, std::span<const int>, std::pmr::vector<int>&);  //перенос узлов другой кнф в конец этой
+    template<class Key>
+    void bypassKeys(int, Key&&, std::unordered_set<int>&);        //bypass без рекурсии
+    void mergeOrder(std::pmr::vector<int>&);                      //порядок переноса узлов при слиянии
+    bool divideLocal(std::optional<CNF>&, int);
+#ifdef NIR_CHECK_DIVIDE
+    void checkLocalSplit(std::span<const int>);                  //сверка divideLocal с полной разметкой
+#endif
 
 public:
-    CNF();
+    explicit CNF(std::pmr::memory_resource *res = std::pmr::get_default_resource(), CNFScratch *work = nullptr);
     CNF(const CNF& other);
-    ~CNF();
-    CNF& operator=(const CNF&);
+    CNF(CNF&& other) noexcept = default;
+    CNF& operator=(const CNF&) = delete;
+    CNF& operator=(CNF&&) noexcept = default;
     
-    int get_nVar(){                         //геттер для количества объектов
-        return nVar;
+    static void setSparseBackend(bool sparse) {     //списки входящих связей вместо матрицы для новых кнф
+        IncomingRows::setSparse(sparse);
+    }
+    
+    int getId() const {
+        return reg.id;
+    }
+    void attach(NameLocations*, CNFScratch*);   //записывает имена кнф в индекс списка и дальше ведет его
+    
+    int get_nVar() const {                  //геттер для количества объектов
+        return nVar - nDead;
     }
                                        
-    std::string get_varName(int& ind) {    //геттер для имен объектов
+    bool isLeaked(int ind) const {         //узел потерян: до него не дойти ни от одной переменной-указателя
+        return ind >= 1 && ind <= nVar && !dead[ind] && rooted[ind] == 0;
+    }
+    
+    Symbol get_varName(int& ind) {         //геттер для имен объектов
         return var_names[ind];
     }
     
@@ -442,25 +1963,25 @@ public:
         }
     }
     
-    void printCNF();
-    void printVarNames();
+    void printCNF() const;
+    void printVarNames() const;
     
-    int findVarIndex(const std::string&) const;          //поиск индекса объета по имени
+    int findVarIndex(Symbol) const;                      //поиск индекса объета по имени
     int findFieldInd(int) const;                         //поиск идекса узла, к которому обращается объект с
                                                          //идексом ind
-    void deleteNode(std::string&);                               //Вырезает объект из таблицы
-    void freeNode(int&, std::vector<CNF>&, int, int);            //Переносит висячие указатели и удаляет объект
+    void deleteNode(Symbol);                                     //Вырезает объект из таблицы
+    void freeNode(int&, std::pmr::vector<CNF>&, int, int);       //Переносит висячие указатели и удаляет объект
                                                                  //методом deleteNode
-    void bypass(int, int, std::unordered_set<int>&, std::unordered_set<int>&);     //обход таблицы для отслеживания
-                                                                                   //отдельных кнф
-    void checkFictiousBonds(std::unordered_set<int>&, int);        //определени и переопределение фиктивнфх связей
+    BoolVector reachable(const BoolVector&) const;               //узлы, достижимые из заданных
+    int labelComponents(std::pmr::vector<int>&, std::pmr::vector<int>&);   //разметка несвязанных частей кнф
+    void checkFictiousBonds(std::span<const int>, int);            //определени и переопределение фиктивнфх связей
     
-    CNF divide(int);                                           //разделение кнф на несвязанные
+    std::optional<CNF> divide(int);                            //разделение кнф на несвязанные
     
-    void addAlMem(std::string, int, int);                      //метод для добавления новых участков памяти
-    void addPtrVar(std::string, int);                          //добавление переменных-указателей
+    void addAlMem(Symbol, int, int);                           //метод для добавления новых участков памяти
+    void addPtrVar(Symbol, int);                               //добавление переменных-указателей
     void addNULL(int, int);                                    //добавление ссылки на null
-    void point(int&, std::string, int&);                       //добавление связи
+    void point(int&, Symbol);                                  //добавление связи
     void rePoint(int&, int&, int&, int&);                      //перестроение связи
     
     bool isDangling(int&, int);                //проверка на то, что указатель обращается к
@@ -473,220 +1994,537 @@ public:
     std::vector<std::vector<int>> buildCNF();
     bool isSatisfiableDPLL();
     void printCNFFormula();
-    void printDPLLResult(const std::unordered_map<std::string, int>& nameToIdTable);
+    void printDPLLResult(const std::unordered_map<Symbol, int>& nameToIdTable);
     void printDPLLResult();
     
-    void analyzeVariableTable(const std::unordered_map<std::string, int>& nameToIdTable);
+    void analyzeVariableTable(const std::unordered_map<Symbol, int>& nameToIdTable);
 };
 
-CNF::CNF() {
-    nVar = 0;
-    pos_type1 = new BoolVector[1]();         //создаем вектор длины 1, так, чтобы в кнф всегда
+CNF::CNF(std::pmr::memory_resource *res, CNFScratch *work)
+    : memory(res), ptr_var(1, res), pos_type1(res), pos_type2(res), neg(res), var_names(res), nameToSlot(res),
+      dead(1, res), slotKey(res), keySlot(res), touched(res), cutTargets(res), openRows(1, res),
+      rooted(1, res), changedRows(res), oldTargets(res), linkedFrom(1, res),
+      scratch(work ? work : &CNFScratch::shared()) {
+    nDead = 0;
+    settled = false;
+    settledFields = 0;
+    nOpen = 0;
+    nVar = 0;                                //наборы строк создаются с одной строкой длины 1, так, чтобы в кнф всегда
                                              //был один элемент - null
-    pos_type2 = new BoolVector[1]();
-    neg = new BoolVector[1]();               //пример - neg[0] = [0]
-    ptr_var = BoolVector(1);
-    
-    var_names.push_back("nullptr");
+                                             //пример - neg[0] = [0]
+    var_names.push_back(symbols().intern("nullptr"));   //null есть в каждой кнф, в индекс имен не попадает
+    nameToSlot.emplace(var_names[0], 0);
+    slotKey.push_back(0);
+    keySlot.push_back(0);
 }
 
-CNF::CNF(const CNF& other) {
-    
-    pos_type1 = nullptr;
-    pos_type2 = nullptr;
-    neg = nullptr;
-    
-    nVar = other.nVar;
-    var_names = other.var_names;
-    ptr_var = other.ptr_var;
-    
-    if (nVar > 0 && other.pos_type1 != nullptr && other.pos_type2 != nullptr && other.neg != nullptr) {
-        pos_type1 = new BoolVector[nVar + 1];
-        pos_type2 = new BoolVector[nVar + 1];
-        neg = new BoolVector[nVar + 1];
-        
-        for (int i = 0; i <= nVar; i++) {
-            pos_type1[i] = other.pos_type1[i];
-            pos_type2[i] = other.pos_type2[i];
-            neg[i] = other.neg[i];
+//Копия берет память из ресурса оригинала: у pmr-контейнеров и BoolVector копия по умолчанию - из ресурса
+//по умолчанию, а копия кнф, которая попадет в список, должна лежать в пуле трассы, как и оригинал
+CNF::CNF(const CNF& other)
+    : memory(other.memory), ptr_var(other.ptr_var, memory), pos_type1(other.pos_type1), pos_type2(other.pos_type2),
+      neg(other.neg), var_names(other.var_names, memory), nameToSlot(other.nameToSlot, memory),
+      dead(other.dead, memory), nDead(other.nDead), nVar(other.nVar), slotKey(other.slotKey, memory),
+      keySlot(other.keySlot, memory), reg(other.reg),
+      settled(other.settled), settledFields(other.settledFields), touched(other.touched, memory),
+      cutTargets(other.cutTargets, memory), openRows(other.openRows, memory), nOpen(other.nOpen),
+      rooted(other.rooted, memory), changedRows(other.changedRows, memory), oldTargets(other.oldTargets, memory),
+      linkedFrom(other.linkedFrom), scratch(other.scratch) {}
+
+void CNF::resizeB(int new_nVar) {                              //для изменения размера кнф(при удалении/добалении)
+    int width = std::max(nVar, new_nVar) + 1;                  //ширина строк, под которую выбирается их тип
+    auto resizeRows = [&](auto &rows) {
+        rows.reshape(new_nVar + 1, width);
+        if (new_nVar > nVar) {
+            rows.widenRows(nVar + 1);
+        } else {
+            rows.truncateRows(new_nVar + 1, nVar + 1);
         }
-    } else {
-        pos_type1 = new BoolVector[1]();
-        pos_type2 = new BoolVector[1]();
-        neg = new BoolVector[1]();
-        nVar = 0;
+    };
+    resizeRows(pos_type1);
+    resizeRows(pos_type2);
+    resizeRows(neg);
+    
+    ptr_var.resizeA(new_nVar+1);
+    linkedFrom.resize(new_nVar+1);
+    if (new_nVar > nVar) reserveScratch(new_nVar + 1);
+    nVar = new_nVar;
+}
+
+//Рабочие массивы обходов растут вместе с кнф - при добавлении узлов, а не на первом после этого обходе,
+//так что операции над устоявшейся кнф не выделяют память. Емкость растет удвоением.
+//Общие массивы (CNFScratch) уже могут быть больше - их доводит до себя самая большая кнф списка
+void CNF::reserveScratch(int n) {
+    auto reserve = [n](auto &v) {
+        if ((int)v.capacity() < n) v.reserve(std::max(n, 2 * (int)v.capacity()));
+    };
+    reserve(touched);
+    reserve(cutTargets);
+    reserve(changedRows);
+    reserve(oldTargets);
+    CNFScratch &s = *scratch;
+    reserve(s.mark);
+    reserve(s.walk);
+    reserve(s.region);
+    reserve(s.comp);
+    reserve(s.compSizes);
+    reserve(s.forest);
+    reserve(s.rootToComp);
+    reserve(s.compNodes);
+    reserve(s.compStart);
+    reserve(s.head);
+    reserve(s.active);
+    reserve(s.ends);
+    reserve(s.part);
+    reserve(s.newInds);
+    reserve(s.newList);
+    reserve(s.remap);
+    reserve(s.rank);
+    reserve(s.rankSlot);
+    reserve(s.frontWords);
+    reserve(s.nextWords);
+}
+
+//возвращает емкость, набранную при росте компоненты; вызывается, когда кнф заметно уменьшилась
+void CNF::compact() {
+    pos_type1.shrinkToFit();
+    pos_type2.shrinkToFit();
+    neg.shrinkToFit();
+}
+
+//живые слоты в порядке ключей
+template<class F>
+void CNF::forEachLiveInOrder(F &&f) const {
+    for (int slot: keySlot) {
+        if (slot != -1) f(slot);
     }
 }
-CNF::~CNF () {
-    delete[] pos_type1;
-    delete[] pos_type2;
-    delete[] neg;
+
+//rank[slot] - номер живого слота в порядке ключей, как индекс после уплотнения
+void CNF::keyRanks(std::pmr::vector<int>& rank) const {
+    rank.assign(nVar + 1, -1);
+    int r = 0;
+    forEachLiveInOrder([&](int slot) { rank[slot] = r++; });
 }
 
-CNF& CNF::operator=(const CNF& other) {
-    if (this == &other) return *this;
-    
-    delete[] pos_type1;
-    delete[] pos_type2;
-    delete[] neg;
-    
-    nVar = other.nVar;
-    var_names = other.var_names;
-    ptr_var = other.ptr_var;
-    
-    if (nVar > 0 && other.pos_type1 != nullptr && other.pos_type2 != nullptr && other.neg != nullptr) {
-        pos_type1 = new BoolVector[nVar + 1];
-        pos_type2 = new BoolVector[nVar + 1];
-        neg = new BoolVector[nVar + 1];
-        
-        for (int i = 0; i <= nVar; i++) {
-            pos_type1[i] = other.pos_type1[i];
-            pos_type2[i] = other.pos_type2[i];
-            neg[i] = other.neg[i];
-        }
-    } else {
-        pos_type1 = new BoolVector[1]();
-        pos_type2 = new BoolVector[1]();
-        neg = new BoolVector[1]();
-        nVar = 0;
+//Вывод не уплотняет кнф (его вызывают после каждого события): удаленные слоты пропускаются,
+//а живые узлы нумеруются подряд в порядке ключей - таблица выглядит так же, как после compactSlots.
+//Длина строки - число живых слотов в ее пределах, но не меньше, чем нужно для ее единичных битов
+//(после слияния обменом ключ узла может оказаться дальше его слота)
+template<class Row>
+void CNF::printLive(const Row &row) const {
+    int len = std::min(row.bitCount(), nVar + 1);
+    int shown = 0;                                      //длина строки после уплотнения
+    int k = 0;
+    forEachLiveInOrder([&](int j) {
+        k++;
+        if (j >= len) return;
+        shown++;
+        if (row[j] == 1) shown = std::max(shown, k);
+    });
+    k = 0;
+    forEachLiveInOrder([&](int j) {
+        if (k++ < shown) std::cout << (j < len ? (int)row[j] : 0);
+    });
+    for (int j = shown; j < (shown + 7) / 8 * 8; j++) {  //выводим с точностью до байта
+        std::cout << 0;
     }
-    
-    return *this;
 }
 
-void CNF::resizeB(int new_nVar) {                              //для изменения размера кнф(при удалении/добалении)
-    BoolVector* new_pos1 = new BoolVector[new_nVar + 1];
-    BoolVector* new_pos2 = new BoolVector[new_nVar + 1];
-    BoolVector* new_neg = new BoolVector[new_nVar + 1];
+void CNF::printCNF() const {                 //вывод таблицы
+    forEachLiveInOrder([&](int i) {
+        std::cout<<symbols().name(var_names[i])<< ' ';
+    });
+    std::cout<<std::endl;
+    std::cout<<"ptr_var[";
+    printLive(ptr_var);
+    std::cout<<"]"<<std::endl;
+    int k = 0;                                          //номер узла без учета удаленных
+    forEachLiveInOrder([&](int i) {
+        std::cout<< "pos1["<<k<<"]";
+        printLive(pos_type1[i]);
+        std::cout<<" "<< "pos2["<<k<<"]";
+        printLive(pos_type2[i]);
+        std::cout<<" "<<"neg["<<k<<"]";
+        printLive(neg[i]);
+        std::cout<<std::endl;
+        k++;
+    });
+}
+
+void CNF::printVarNames() const {
+    std::cout << "var_names (" << nVar + 1 - nDead << " элементов): ";
+            int k = 0;
+            forEachLiveInOrder([&](int i) {
+                std::cout << "[" << k++ << "]:" << symbols().name(var_names[i]) << " ";
+            });
+            std::cout << std::endl;
+}
+
+void CNF::addName(Symbol name) {
+    var_names.push_back(name);
+    slotKey.push_back((int)keySlot.size());
+    keySlot.push_back((int)var_names.size() - 1);
+    nameToSlot.emplace(name, (int)var_names.size() - 1);    //при повторе имени остается первый слот, как при линейном поиске
+    if (reg.locations) reg.locations->place(name, reg.id);
+}
+
+void CNF::attach(NameLocations *locations, CNFScratch *work) {
+    scratch = work;
+    if (reg.locations == locations) return;
+    reg.locations = locations;
+    for (int i = 1; i <= nVar; i++) {
+        if (!dead[i]) locations->place(var_names[i], reg.id);
+    }
+}
+
+//Функция для поиска узла по имени в КНФ
+int CNF::findVarIndex(Symbol name) const {
+    auto it = nameToSlot.find(name);
+    return it == nameToSlot.end() ? -1 : it->second;
+}
+
+//Функция для поиска следующего узла на который ссылается переменная-указатель
+int CNF::findFieldInd(int indOut) const {
+    return pos_type1[indOut].getLastLink();
+}
+
+//удаление узла
+void CNF::deleteNode(Symbol name) {
+    eraseSlot(findVarIndex(name));
+    updateRooted();
+    if (tombstoneShare * nDead > nVar) compactSlots();
+}
+
+//Обнуляем строку и столбец узла и помечаем слот удаленным; индексы остальных узлов не меняются
+//noteLinks = false - узел удаляется вместе со всей своей компонентой, и связи вокруг него не отслеживаем
+void CNF::eraseSlot(int ind, bool noteLinks) {
+    if (dead[ind]) return;
+    if (noteLinks) {                                //у входящих связей меняются строки-источники
+        std::pmr::vector<int> sources(linkedFrom[ind], memory);
+        for (int i: sources) {
+            noteRowChange(i);
+        }
+        noteRowChange(ind);
+    } else {
+        dropLinksFrom(ind);
+    }
+    if (!linkedFrom[ind].empty()) linkedFrom.edit(ind).clear();
+    pos_type1[ind].Clear();
+    pos_type2[ind].Clear();
+    neg[ind].Clear();
+    pos_type1.clearColumn(ind);
+    pos_type2.clearColumn(ind);
+    neg.clearColumn(ind);
+    ptr_var.Set0(ind);
+    rooted.Set0(ind);
+    auto it = nameToSlot.find(var_names[ind]);
+    if (it != nameToSlot.end() && it->second == ind) nameToSlot.erase(it);
+    if (reg.locations) reg.locations->remove(var_names[ind], reg.id);
+    var_names[ind] = SymbolTable::empty;
+    keySlot[slotKey[ind]] = -1;
+    dead.Set1(ind);
+    nDead++;
+    
+    //после вырезания столбца все строки имели бы длину nVar+1 - в слотах это nVar+1 с учетом удаленных
+    pos_type1.widenRows(nVar + 1);
+    pos_type2.widenRows(nVar + 1);
+    neg.widenRows(nVar + 1);
+}
+
+//Вырезаем все удаленные слоты за один проход по строкам; порядок оставшихся узлов сохраняется
+int CNF::compactSlots(int ind) {
+    if (nDead == 0) return ind;
+    updateRooted();
+    std::pmr::vector<int> rank(nVar + 2, memory);    //rank[k] - сколько живых слотов среди первых k
+    for (int i = 0; i <= nVar; i++) {
+        rank[i + 1] = rank[i] + (dead[i] ? 0 : 1);
+    }
     
-    if (new_nVar > nVar){
-        for (int i = 0; i <= nVar; i++) {
-            new_pos1[i] = BoolVector(nVar+1) | pos_type1[i];
-            new_pos2[i] = BoolVector(nVar+1) | pos_type2[i];
-            new_neg[i] = BoolVector(nVar+1) | neg[i];
-        }
-        for (int i = nVar+1; i <= new_nVar; i++) {
-            new_pos1[i] = BoolVector(nVar+1);
-            new_pos2[i] = BoolVector(nVar+1);
-            new_neg[i] = BoolVector(nVar+1);
-        }
-    } else {
-        for (int i = 0; i <= new_nVar; i++) {
-            new_pos1[i] = BoolVector(nVar + 1);
-            new_pos2[i] = BoolVector(nVar + 1);
-            new_neg[i] = BoolVector(nVar + 1);
-            
-            for (int j = 0; j <= new_nVar; j++) {
-                if (pos_type1[i][j] == 1) new_pos1[i].Set1(j);
-                if (pos_type2[i][j] == 1) new_pos2[i].Set1(j);
-                if (neg[i][j] == 1) new_neg[i].Set1(j);
+    pos_type1.remapSlots(rank);
+    pos_type2.remapSlots(rank);
+    neg.remapSlots(rank);
+    
+    BoolVector ptrs(rank[nVar + 1], ptr_var.get_allocator());
+    ptr_var.forEachSetBit([&](int i) { ptrs.Set1(rank[i]); });
+    ptr_var = std::move(ptrs);
+    BoolVector reach(rank[nVar + 1], rooted.get_allocator());
+    rooted.forEachSetBit([&](int i) { reach.Set1(rank[i]); });
+    rooted = std::move(reach);
+    for (int i = 0; i <= nVar; i++) {
+        if (dead[i]) continue;
+        std::pmr::vector<int> &sources = linkedFrom.edit(i);
+        int n = 0;
+        for (int from: sources) {
+            if (!dead[from]) sources[n++] = rank[from];
+        }
+        sources.resize(n);
+        if (rank[i] != i) linkedFrom.edit(rank[i]) = std::move(sources);
+    }
+    linkedFrom.resize(rank[nVar + 1]);
+    
+    if (settled) {                                  //запомненные изменения переводим в новые индексы
+        updateOpenRows();
+        auto remapList = [&](std::pmr::vector<int>& list) {
+            int n = 0;
+            for (int i: list) {
+                if (!dead[i]) list[n++] = rank[i];
             }
+            list.resize(n);
+        };
+        remapList(touched);
+        remapList(cutTargets);
+        BoolVector open(rank[nVar + 1], openRows.get_allocator());
+        openRows.forEachSetBit([&](int i) {
+            if (!dead[i]) open.Set1(rank[i]);
+        });
+        openRows = std::move(open);
+    }
+    
+    int k = 0;
+    for (int i = 0; i <= nVar; i++) {
+        if (dead[i]) continue;
+        if (k != i) {
+            auto it = nameToSlot.find(var_names[i]);
+            if (it != nameToSlot.end() && it->second == i) it->second = k;
+            var_names[k] = var_names[i];
         }
+        k++;
+    }
+    var_names.resize(k);
+    
+    int key = 0;                                    //ключи подряд, в прежнем порядке
+    for (int slot: keySlot) {
+        if (slot == -1) continue;
+        slotKey[rank[slot]] = key;
+        keySlot[key++] = rank[slot];
     }
+    keySlot.resize(key);
+    slotKey.resize(key);
     
+    dead.Clear();
+    nDead = 0;
+    nVar = rank[nVar + 1] - 1;
     
-    delete[] pos_type1;
-    delete[] pos_type2;
-    delete[] neg;
-        
-    ptr_var.resizeA(new_nVar+1);
-    pos_type1 = new_pos1;
-    pos_type2 = new_pos2;
-    neg = new_neg;
-    nVar = new_nVar;
+    if (4 * (nVar + 1) < neg.capacity()) compact();     //кнф уменьшилась в 4 раза - отдаем лишнюю память
+    return rank[ind];
 }
 
-void CNF::printCNF() {                       //вывод таблицы
-    for (int i = 0; i <= nVar; i++) {
-        std::cout<<var_names[i]<< ' ';
-    }
-    std::cout<<std::endl;
-    std::cout<<"ptr_var["<<ptr_var<<"]"<<std::endl;
-    for (int i = 0; i<=nVar; i++) {
-        std::cout<< "pos1["<<i<<"]"<<pos_type1[i]<<" "<< "pos2["<<i<<"]"<<pos_type2[i]<<" "<<"neg["<<i<<"]"<<neg[i]<<std::endl;;
+//узел незамкнут, если хотя бы одно поле никуда не указывает (ни на узел, ни на null)
+bool CNF::isOpen(int i, int nFields) const {
+    if (nFields == 2) return !(pos_type1[i].hasWeight() && pos_type2[i].hasWeight());
+    return !pos_type1[i].hasWeight();
+}
+
+//Вызывается после полной разметки, если кнф - одна компонента без потерянных узлов
+void CNF::settle(int nFields) {
+    settled = true;
+    settledFields = nFields;
+    touched.clear();
+    cutTargets.clear();
+    openRows.resizeA(nVar + 1);                     //буфер прошлой разметки используется заново
+    openRows.Clear();
+    nOpen = 0;
+    for (int i = 1; i <= nVar; i++) {
+        if (!dead[i] && isOpen(i, nFields)) {
+            openRows.Set1(i);
+            nOpen++;
+        }
     }
 }
 
-void CNF::printVarNames() {
-    std::cout << "var_names (" << var_names.size() << " элементов): ";
-            for (int i = 0; i < var_names.size(); i++) {
-                std::cout << "[" << i << "]:" << var_names[i] << " ";
-            }
-            std::cout << std::endl;
+void CNF::unsettle() {
+    settled = false;
+    touched.clear();
+    cutTargets.clear();
 }
 
-//Функция для поиска узла по имени в КНФ
-int CNF::findVarIndex(const std::string& name) const {
-    for (int i = 0; i < var_names.size(); i++) {
-        if (var_names[i] == name) {
-            return i;
+//Запоминаем строку и ее прежние цели до изменения - для updateRooted и, если кнф устоялась, для divide.
+//Если изменений набралось больше, чем узлов, локальная проверка уже не выгодна - ждем полной разметки
+void CNF::noteRowChange(int i) {
+    int next = pos_type1[i].getLink();
+    int pr = pos_type2[i].getLink();
+    dropLinksFrom(i);
+    changedRows.push_back(i);
+    if (next != -1) oldTargets.push_back(next);
+    if (pr != -1) oldTargets.push_back(pr);
+    if (!settled) return;
+    touched.push_back(i);
+    if (next != -1) cutTargets.push_back(next);
+    if (pr != -1) cutTargets.push_back(pr);
+    if ((int)touched.size() + (int)cutTargets.size() > nVar + 1) unsettle();
+}
+
+//новый узел: его строка меняется, а для divide надо проверить, что он достижим
+void CNF::noteNewNode(int i) {
+    noteRowChange(i);
+    if (settled) cutTargets.push_back(i);
+}
+
+//пересчитываем незамкнутость только для измененных строк
+void CNF::updateOpenRows() {
+    for (int i: touched) {
+        bool open = !dead[i] && isOpen(i, settledFields);
+        if (open == (openRows[i] == 1)) continue;
+        if (open) {
+            openRows.Set1(i);
+            nOpen++;
+        } else {
+            openRows.Set0(i);
+            nOpen--;
         }
     }
-    return -1;
 }
 
-//Функция для поиска следующего узла на который ссылается переменная-указатель
-int CNF::findFieldInd(int indOut) const {
-    int ind = -1;
-    for (int i = 1; i <= nVar; i++) {
-        if(pos_type1[indOut][i] == 1) ind = i;
+//выделяет k свежих меток: mark[i] - base + s значит, что узел i посещен обходом s
+unsigned CNF::newMarks(int k) {
+    std::pmr::vector<unsigned> &mark = scratch->mark;
+    unsigned &markBase = scratch->markBase;
+    if ((int)mark.size() < nVar + 1) mark.resize(nVar + 1, 0);
+    if (markBase > UINT_MAX - k - 1) {
+        std::fill(mark.begin(), mark.end(), 0);
+        markBase = 0;
+    }
+    unsigned base = markBase + 1;
+    markBase += k;
+    return base;
+}
+
+//связи строки i в linkedFrom; null (строка 0) ведет только фиктивные связи, их не учитываем
+void CNF::addLinksFrom(int i) {
+    if (i == 0) return;
+    for (int to: {pos_type1[i].getLink(), pos_type2[i].getLink()}) {
+        if (to < 1) continue;
+        std::pmr::vector<int> &sources = linkedFrom.edit(to);
+        if (std::find(sources.begin(), sources.end(), i) == sources.end()) sources.push_back(i);
     }
-    return ind;
 }
 
-//удаление узла
-void CNF::deleteNode(std::string& name) {
-    //"Вырезаем"(сдвигаем следующие за ним узлы) удаляемый узел из строк
-    int ind = findVarIndex(name);
-    for (int i = ind; i <= nVar - 1; i++) {
-        pos_type1[i] = pos_type1[i + 1];
-        pos_type2[i] = pos_type2[i + 1];
-        neg[i] = neg[i + 1];
-        
-        if (ptr_var[i + 1] == 1) {
-            ptr_var.Set1(i);
-        } else {
-            ptr_var.Set0(i);
+void CNF::dropLinksFrom(int i) {
+    if (i == 0) return;
+    for (int to: {pos_type1[i].getLink(), pos_type2[i].getLink()}) {
+        if (to < 1) continue;
+        std::pmr::vector<int> &sources = linkedFrom.edit(to);
+        auto it = std::find(sources.begin(), sources.end(), i);
+        if (it != sources.end()) {
+            *it = sources.back();
+            sources.pop_back();
         }
     }
-    ptr_var.Set0(nVar);
-    
-    //"Вырезаем" удаляемый узел из столбцов
-    for (int i = 0; i <= nVar; i++) {
-        for (int j = ind; j < nVar; j++) {
-            
-            if (pos_type1[i][j + 1] == 1) {
-                pos_type1[i].Set1(j);
-            } else {
-                pos_type1[i].Set0(j);
-            }
-                
-            if (pos_type2[i][j + 1] == 1) {
-                pos_type2[i].Set1(j);
-            } else {
-                pos_type2[i].Set0(j);
+}
+
+//Обратный обход по входящим связям до первой переменной-указателя
+bool CNF::reachesFromPointer(int start) {
+    std::pmr::vector<int> &walk = scratch->walk;
+    std::pmr::vector<unsigned> &mark = scratch->mark;
+    unsigned base = newMarks(1);
+    walk.assign(1, start);
+    mark[start] = base;
+    while (!walk.empty()) {
+        int cur = walk.back();
+        walk.pop_back();
+        if (ptr_var[cur] == 1) {
+            walk.clear();
+            return true;
+        }
+        for (int from: linkedFrom[cur]) {
+            if (mark[from] == base) continue;
+            mark[from] = base;
+            walk.push_back(from);
+        }
+    }
+    return false;
+}
+
+//помечаем достижимым все, куда можно дойти от узлов walk (сами они уже помечены)
+void CNF::spreadRooted() {
+    std::pmr::vector<int> &walk = scratch->walk;
+    while (!walk.empty()) {
+        int cur = walk.back();
+        walk.pop_back();
+        for (int to: {pos_type1[cur].getLink(), pos_type2[cur].getLink()}) {
+            if (to >= 1 && rooted[to] == 0) {
+                rooted.Set1(to);
+                walk.push_back(to);
             }
-                
-            if (neg[i][j + 1] == 1) {
-                neg[i].Set1(j);
-            } else {
-                neg[i].Set0(j);
+        }
+    }
+}
+
+//До start больше нет пути от переменных-указателей. Снимаем пометку со всего помеченного за ним,
+//затем возвращаем ее узлам области, в которые ведет связь из помеченного узла вне области,
+//и всему, что достижимо из них
+void CNF::unrootFrom(int start) {
+    std::pmr::vector<int> &region = scratch->region;
+    region.assign(1, start);
+    rooted.Set0(start);
+    for (int k = 0; k < (int)region.size(); k++) {
+        int cur = region[k];
+        for (int to: {pos_type1[cur].getLink(), pos_type2[cur].getLink()}) {
+            if (to >= 1 && rooted[to] == 1) {
+                rooted.Set0(to);
+                region.push_back(to);
             }
         }
-        pos_type1[i].Set0(nVar);
-        pos_type2[i].Set0(nVar);
-        neg[i].Set0(nVar);
     }
-    nVar--;
-    
-    int indToDel = findVarIndex(name);                //ищем по имени какой индекс удалить
-    var_names.erase(var_names.begin() + indToDel);
-    
-    resizeB(nVar);
+    for (int cur: region) {
+        bool reached = ptr_var[cur] == 1;
+        for (int from: linkedFrom[cur]) {
+            if (rooted[from] == 1) reached = true;
+        }
+        if (reached && rooted[cur] == 0) {
+            rooted.Set1(cur);
+            scratch->walk.push_back(cur);
+        }
+    }
+    spreadRooted();
+}
+
+//Сначала распространяем достижимость по новым связям измененных строк, затем проверяем прежние цели:
+//если до цели еще есть путь от переменной-указателя, достижимо и все за ней, иначе перестраиваем область.
+//Разрывы обрабатываются вторыми, так что ошибочно помеченное на первом шаге лежит в перестраиваемой области.
+//Каждая проверка может обойти всю кнф, поэтому при большом числе прежних целей (слияние, удаление узла
+//со многими входящими связями, маленькая кнф) дешевле один проход reachable от всех переменных-указателей
+void CNF::updateRooted() {
+    bool rescan = rescanShare * (int)oldTargets.size() > nVar - nDead;
+    for (int i: changedRows) {
+        if (i > nVar || dead[i]) continue;
+        addLinksFrom(i);
+        if (rescan) continue;
+        if (ptr_var[i] == 1) rooted.Set1(i);
+        if (rooted[i] == 1) scratch->walk.push_back(i);
+    }
+    if (rescan) {
+        rooted = reachable(ptr_var);
+        changedRows.clear();
+        oldTargets.clear();
+        return;
+    }
+    spreadRooted();
+    for (int t: oldTargets) {
+        if (t <= nVar && !dead[t] && rooted[t] == 1 && !reachesFromPointer(t)) unrootFrom(t);
+    }
+    changedRows.clear();
+    oldTargets.clear();
+}
+
+//фиктивные связи для устоявшейся кнф: список - все ее узлы, замкнутость знаем по nOpen
+void CNF::setFictiousBonds() {
+    setNullBonds(nOpen == 0);
+}
+
+//фиктивные связи из null во все переменные-указатели (closed) или их снятие: строка null меняется
+//одной операцией над словами, а не по биту на переменную
+void CNF::setNullBonds(bool closed) {
+    if (closed) pos_type1[0] |= ptr_var;
+    else pos_type1[0].andNot(ptr_var);
+    ptr_var.forEachSetBit([&](int i) {
+        if (closed) neg[i].Set1(0);
+        else neg[i].Set0(0);
+    });
 }
 
 //удаление с перенос висячих указателей
-void CNF::freeNode(int& ind, std::vector<CNF>& danglingPointers, int nFields = 1, int fieldType = 1) {
+void CNF::freeNode(int& ind, std::pmr::vector<CNF>& danglingPointers, int nFields = 1, int fieldType = 1) {
     int indToFree;
     
     if (fieldType == 1) {                      //ищем индес узла, который хотим освободить
@@ -695,101 +2533,151 @@ void CNF::freeNode(int& ind, std::vector<CNF>& danglingPointers, int nFields = 1
         indToFree = pos_type2[ind].getLink();
     }
     
-    std::string nameToFree = var_names[indToFree];       //запоминаем его имя, т.к. при удалении других объектов
-                                                         //индексы меняются
-    
-    std::unordered_set<std::string> namesToDel;         //Смотрим, не появилось ли висящих указателей
-    for (int i = 1; i <= nVar; i++) {
-        if (neg[indToFree][i] && ptr_var[i]) {
-            CNF pointer;                                  //переносим в новую кнф
-            pointer.addPtrVar(var_names[i], nFields);
-            danglingPointers.push_back(pointer);
-            namesToDel.insert(var_names[i]);
-        }
-    }
-    for (std::string name: namesToDel) {
-        deleteNode(name);
-    }
-    
-    deleteNode(nameToFree);
-}
-
-//Обходим, начиная с переменной-указателя
-void CNF::bypass(int cur, int prev, std::unordered_set<int>& list, std::unordered_set<int>& visited) {
-    // Если узел уже посещен, выходим чтобы избежать зацикливания
-    if (visited.count(cur)) {
-        return;
+    std::pmr::vector<int> toDel(memory);                //Смотрим, не появилось ли висящих указателей
+    neg[indToFree].forEachSetBit([&](int i) {
+        if (i >= 1 && ptr_var[i]) toDel.push_back(i);
+    });
+    std::sort(toDel.begin(), toDel.end(), [&](int a, int b) { return slotKey[a] < slotKey[b]; });
+    for (int i: toDel) {
+        CNF& pointer = danglingPointers.emplace_back(memory, scratch);     //переносим в новую кнф
+        pointer.addPtrVar(var_names[i], nFields);
     }
-    
-    visited.insert(cur);
-    list.insert(cur);
-    
-    int next = pos_type1[cur].getLink();
-    if (next != -1 && next != prev) {
-        bypass(next, cur, list, visited);
+    for (int i: toDel) {                                //слоты не перенумеровываются, индексы остаются верными
+        eraseSlot(i);
     }
+    eraseSlot(indToFree);
+    updateRooted();
     
-    int pr = pos_type2[cur].getLink();
-    if (pr != -1 && pr != prev && pr != next) {
-        bypass(pr, cur, list, visited);
-    }
+    if (tombstoneShare * nDead > nVar) compactSlots();
 }
 
-//функция для обработки списков, сформированных обходом bypass
-bool hasIntersection(const std::unordered_set<int>& set1, const std::unordered_set<int>& set2) {
-    for (int elem : set1) {
-        if (set2.count(elem)) return true;
+//Все узлы, достижимые из sources (сами источники тоже входят), за один проход для любого числа корней.
+//Обход в ширину без рекурсии: фронт - битовый вектор и список его ненулевых слов. Цели связей узлов фронта
+//собираются в next словами, из которых сразу вычитаются достигнутые (next &= ~reached), затем
+//reached |= фронт - только по словам из списка, так что шаг стоит порядка размера фронта, а не всей кнф.
+//null (бит 0) не обходится
+BoolVector CNF::reachable(const BoolVector& sources) const {
+    BoolVector reached(nVar + 1, memory);
+    BoolVector frontier(nVar + 1, memory);
+    BoolVector next(nVar + 1, memory);
+    std::pmr::vector<int> &words = scratch->frontWords;
+    std::pmr::vector<int> &nextWords = scratch->nextWords;
+    words.clear();
+    nextWords.clear();
+    reached.v[0] = 1;                               //null считаем достигнутым, чтобы не попал во фронт
+    auto add = [&](BoolVector& to, std::pmr::vector<int>& toWords, int w, std::uint64_t bits) {
+        bits &= ~reached.v[w];
+        if (bits == 0) return;
+        if (to.v[w] == 0) toWords.push_back(w);
+        to.v[w] |= bits;
+    };
+    for (int w = 0; w < std::min(reached.m, sources.m); w++) {
+        add(frontier, words, w, sources.v[w]);
+    }
+    while (!words.empty()) {
+        for (int w: words) {
+            reached.v[w] |= frontier.v[w];
+        }
+        for (int w: words) {
+            for (std::uint64_t b = frontier.v[w]; b != 0; b &= b - 1) {
+                int i = w * 64 + std::countr_zero(b);
+                for (int to: {pos_type1[i].getLink(), pos_type2[i].getLink()}) {
+                    if (to >= 1 && to <= nVar) add(next, nextWords, to / 64, std::uint64_t(1) << (to % 64));
+                }
+            }
+            frontier.v[w] = 0;
+        }
+        std::swap(frontier, next);
+        std::swap(words, nextWords);
+        nextWords.clear();
     }
-    return false;
+    reached.Set0(0);
+    return reached;
 }
 
-//ищем уникальные списки, для разделения кнф
-std::vector<std::unordered_set<int>> findUnique(const std::vector<std::unordered_set<int>>& lists) {
-    std::vector<std::unordered_set<int>> result;
-    std::vector<bool> merged(lists.size(), false);
-    
-    for (int i = 0; i < lists.size(); i++) {
-        if (merged[i]) continue;                 //если объект уже попадался
-        
-        std::unordered_set<int> current = lists[i];
-        merged[i] = true;
-        
-        bool changed;
-        do {
-            changed = false;
-            for (int j = 0; j < lists.size(); j++) {
-                if (!merged[j] && hasIntersection(current, lists[j])) {
-                    current.insert(lists[j].begin(), lists[j].end());       //добавляем очередной объект в список
-                    merged[j] = true;
-                    changed = true;
-                }
+//Размечаем узлы, достижимые из переменных-указателей, номерами компонент.
+//Обходим от каждой переменной-указателя по очереди; встретив узел, помеченный одним из прошлых обходов,
+//объединяем обходы в системе непересекающихся множеств и дальше не идем - все, что достижимо из этого узла,
+//уже помечено. Каждый узел посещается один раз.
+//Компоненты нумеруются по первой переменной-указателю в порядке ключей, sizes[c] - число узлов в компоненте c, comp[i] == -1 для потерянных узлов
+int CNF::labelComponents(std::pmr::vector<int>& comp, std::pmr::vector<int>& sizes) {
+    comp.assign(nVar+1, -1);                        //сначала храним номер обхода, впервые дошедшего до узла
+    std::pmr::vector<int> &parent = scratch->forest;    //лес обходов, корень - обход с наименьшим номером
+    std::pmr::vector<int> &stack = scratch->walk;
+    std::pmr::vector<int> &rootToComp = scratch->rootToComp;
+    parent.clear();
+    stack.clear();
+    auto findRoot = [&](int t) {
+        while (parent[t] != t) {
+            parent[t] = parent[parent[t]];
+            t = parent[t];
+        }
+        return t;
+    };
+    for (int i: keySlot) {
+        if (i < 1 || ptr_var[i] != 1) continue;
+        int t = (int)parent.size();
+        parent.push_back(t);
+        stack.push_back(i);
+        while (!stack.empty()) {
+            int cur = stack.back();
+            stack.pop_back();
+            if (comp[cur] != -1) {                  //узел уже обойден - объединяем
+                int a = findRoot(comp[cur]);
+                int b = findRoot(t);
+                if (a < b) parent[b] = a;
+                else parent[a] = b;
+                continue;
             }
-        } while (changed);
-        
-        result.push_back(current);
+            comp[cur] = t;
+            int next = pos_type1[cur].getLink();
+            if (next != -1) stack.push_back(next);
+            int pr = pos_type2[cur].getLink();
+            if (pr != -1 && pr != next) stack.push_back(pr);
+        }
     }
-    
-    return result;
+    rootToComp.assign(parent.size(), -1);
+    sizes.clear();
+    for (int t = 0; t < (int)parent.size(); t++) {
+        int r = findRoot(t);
+        if (rootToComp[r] == -1) {
+            rootToComp[r] = (int)sizes.size();
+            sizes.push_back(0);
+        }
+    }
+    for (int i = 1; i <= nVar; i++) {
+        if (comp[i] == -1) continue;
+        comp[i] = rootToComp[findRoot(comp[i])];
+        sizes[comp[i]]++;
+    }
+    return (int)sizes.size();
 }
 
 //Проверка и корректировка фиктивных связей
-void CNF::checkFictiousBonds(std::unordered_set<int>& list, int nFields) {
+void CNF::checkFictiousBonds(std::span<const int> list, int nFields) {
     int ctr = 0;
+    int ptrs = 0;
     //для формирования фиктивных связей нужно чтобы каждый объект указывал куда-либо(узел или null)
     if (nFields == 2){     //если работаем с двусвязным
         for (int nodeInd: list) {
             if (pos_type1[nodeInd].hasWeight() && pos_type2[nodeInd].hasWeight()){
                 ctr++;              //для двусвязного списка вектор pos_type2 для переменных-указателей сразу инициализируется с ссылкой на null
             }
+            ptrs += ptr_var[nodeInd];
         }
     } else {               //если работаем с односвязным
         for (int nodeInd: list) {
             if (pos_type1[nodeInd].hasWeight()){
                 ctr++;
             }
+            ptrs += ptr_var[nodeInd];
         }
     }
-    if (ctr == list.size()) {
+    if (ptrs == ptr_var.getWeight()) {          //в списке все переменные-указатели кнф - строка null целиком
+        setNullBonds(ctr == (int)list.size());
+        return;
+    }
+    if (ctr == (int)list.size()) {
         for (int nodeInd: list) {             //Если все объекты "закрыты", то мы проводим фиктивные связи из null в переменные-указатели
             if (ptr_var[nodeInd] == 1) {
                 pos_type1[0].Set1(nodeInd);
@@ -806,64 +2694,88 @@ void CNF::checkFictiousBonds(std::unordered_set<int>& list, int nFields) {
     }
 }
 
-//для разделения кнф
-CNF CNF::divide(int nFields) {
-    CNF cnf;
-    std::vector<std::unordered_set<int>> lists;     //для каждой переменной-указателся составляем списки объектов, достижимых из нее
-    for (int i = 1; i <= nVar; i++) {
-        if (ptr_var[i] == 1) {
-            std::unordered_set<int> list;
-            std::unordered_set<int> visited;
-            bypass(i, -1, list, visited);
-            lists.push_back(list);
+//Порядок, в котором отделяемая часть part попадает в новую кнф (от него зависят номера ее узлов в выводе,
+//а через номера - выбор части при равных размерах в следующих divide). Прежде divide уплотнял кнф, собирал
+//для каждой переменной-указателя std::unordered_set индексов достижимых из нее узлов (bypass), объединял
+//пересекающиеся множества (findUnique) и нумеровал новую кнф в порядке итерации объединенного множества.
+//Этот порядок сохранен: множества строятся из тех же чисел - номеров узлов в порядке ключей - теми же
+//вставками, но только для указателей самой части. Работа - порядка (число указателей части) x (размер части)
+void CNF::splitOrder(std::span<const int> part, std::pmr::vector<int>& order) {
+    std::pmr::vector<int> &rank = scratch->rank;
+    std::pmr::vector<int> &rankSlot = scratch->rankSlot;
+    keyRanks(rank);
+    rankSlot.resize(nVar + 1 - nDead);
+    std::vector<int> ptrs;                          //указатели части в порядке ключей
+    for (int i: part) {
+        rankSlot[rank[i]] = i;
+        if (ptr_var[i] == 1) ptrs.push_back(i);
+    }
+    std::sort(ptrs.begin(), ptrs.end(), [&](int a, int b) { return rank[a] < rank[b]; });
+    
+    std::vector<std::unordered_set<int>> lists(ptrs.size());
+    for (int k = 0; k < (int)ptrs.size(); k++) {
+        bypassKeys(ptrs[k], [&](int j) { return rank[j]; }, lists[k]);
+    }
+    //findUnique для одной компоненты: все ее множества пересекаются по цепочке и сливаются в первое
+    std::vector<bool> merged(lists.size(), false);
+    std::unordered_set<int> current = lists[0];
+    merged[0] = true;
+    bool changed;
+    do {
+        changed = false;
+        for (int j = 0; j < (int)lists.size(); j++) {
+            if (merged[j]) continue;
+            bool intersects = false;
+            for (int elem: current) {
+                if (lists[j].count(elem)) {
+                    intersects = true;
+                    break;
+                }
+            }
+            if (intersects) {
+                current.insert(lists[j].begin(), lists[j].end());
+                merged[j] = true;
+                changed = true;
+            }
         }
-    }
-    std::vector<std::unordered_set<int>> listsUnique = findUnique(lists);    //т.к. эти списки могут пересекаться, находим пересечения и составляем уникальные списки
+    } while (changed);
     
-    if( listsUnique.size() == 0) {
-        return cnf;
-    }
-    if (listsUnique.size() == 1) {
-        checkFictiousBonds(listsUnique[0], nFields);
-        return cnf;
-    }
-    checkFictiousBonds(listsUnique[0], nFields);
-    int shortInd = 0;
-    for (int i = 1; i < listsUnique.size(); i++) {
-        if (listsUnique[i].size() < listsUnique[shortInd].size()) {
-            shortInd = i;
-        }
+    order.clear();
+    for (int r: current) {
+        order.push_back(rankSlot[r]);
     }
-    cnf.resizeB((int)listsUnique[shortInd].size());
+}
+
+//Перенос узлов part (в порядке splitOrder) в пустую кнф cnf; newInds - их новые индексы
+void CNF::splitOff(CNF& cnf, std::span<const int> part, std::pmr::vector<int>& newInds) {
+    cnf.resizeB((int)part.size());
     
-    std::vector<int> oldToNew(nVar+1, -1);
-    std::unordered_set<int> newInds;
+    std::pmr::vector<int> &oldToNew = scratch->remap;
+    oldToNew.assign(nVar+1, -1);
     
     int newInd = 1;
     
-    for (int oldInd: listsUnique[shortInd]) {               //переопределяем индексы
+    for (int oldInd: part) {               //переопределяем индексы
         oldToNew[oldInd] = newInd;
-        cnf.var_names.push_back(var_names[oldInd]);
+        cnf.addName(var_names[oldInd]);
         if (ptr_var[oldInd] == 1) cnf.ptr_var.Set1(newInd);
-        newInds.insert(newInd);
+        cnf.rooted.Set1(newInd);                            //переносится компонента - все ее узлы достижимы
+        newInds.push_back(newInd);
         newInd++;
     }
     //Перенос в новую КНФ с ссылкой на null
-    for (int oldFrom: listsUnique[shortInd]) {
+    for (int oldFrom: part) {
         int newFrom = oldToNew[oldFrom];
-        for (int oldTo: listsUnique[shortInd]) {
-            int newTo = oldToNew[oldTo];
-            
-            if (pos_type1[oldFrom][oldTo] == 1) {
-                cnf.pos_type1[newFrom].Set1(newTo);
-            }
-            if (pos_type2[oldFrom][oldTo] == 1) {
-                cnf.pos_type2[newFrom].Set1(newTo);
-            }
-            if (neg[oldFrom][oldTo] == 1) {
-                cnf.neg[newFrom].Set1(newTo);
-            }
-        }
+        //идем только по единичным битам, связи вне компоненты отбрасываем
+        pos_type1[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= nVar && oldToNew[oldTo] != -1) cnf.pos_type1[newFrom].Set1(oldToNew[oldTo]);
+        });
+        pos_type2[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= nVar && oldToNew[oldTo] != -1) cnf.pos_type2[newFrom].Set1(oldToNew[oldTo]);
+        });
+        neg[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= nVar && oldToNew[oldTo] != -1) cnf.neg[newFrom].Set1(oldToNew[oldTo]);
+        });
         if (pos_type1[oldFrom][0] == 1){
             cnf.pos_type1[newFrom].Set1(0);
             cnf.neg[0].Set1(newFrom);
@@ -873,67 +2785,270 @@ CNF CNF::divide(int nFields) {
             cnf.neg[0].Set1(newFrom);
         }
     }
+    for (int i = 1; i <= cnf.nVar; i++) {
+        cnf.addLinksFrom(i);
+    }
     
-    std::unordered_set<std::string> namesToDel;         //Удаляем перенесенные узлы из старой кнф
-    for (int oldInd: listsUnique[shortInd]) {
-        namesToDel.insert(var_names[oldInd]);
+    for (int oldInd: part) {          //Удаляем перенесенные узлы из старой кнф
+        eraseSlot(oldInd, false);
     }
-    for (std::string name: namesToDel) {
-        deleteNode(name);
+}
+
+//Разделение устоявшейся кнф без полного обхода. Потерянные узлы могут появиться только за прежними
+//целями измененных связей, так что если эти цели все еще достижимы из переменных-указателей,
+//компоненты совпадают со связными частями графа (направление связей не важно). Связность проверяем
+//встречными обходами от концов изменений, по узлу каждым по очереди: пересекшиеся обходы объединяются,
+//а обход, которому некуда идти, перечислил отколовшуюся часть целиком. Поэтому работа - порядка
+//меньшей части, а для неразделившейся кнф - порядка пути до встречи. Обратные связи берутся из linkedFrom,
+//а не из neg: в neg бывают биты связей, которых уже нет, и обход по ним не замечал разделения.
+//Возвращает false, если случай не разбирается локально (потерянные узлы, больше двух частей,
+//отколовшаяся часть не меньше оставшейся) - тогда divide делает полную разметку.
+bool CNF::divideLocal(std::optional<CNF>& cnf, int nFields) {
+    std::pmr::vector<int> &ends = scratch->ends;
+    std::pmr::vector<int> &part = scratch->part;
+    std::pmr::vector<int> &head = scratch->head;
+    std::pmr::vector<int> &active = scratch->active;
+    std::pmr::vector<int> &newInds = scratch->newInds;
+    std::pmr::vector<unsigned> &mark = scratch->mark;
+    updateOpenRows();
+    
+    ends.clear();                                   //живые концы изменений без повторов
+    unsigned base = newMarks(1);
+    for (int list = 0; list < 2; list++) {
+        for (int i: list == 0 ? touched : cutTargets) {
+            if (i > nVar || dead[i] || mark[i] == base) continue;
+            mark[i] = base;
+            ends.push_back(i);
+        }
+    }
+    for (int t: cutTargets) {
+        if (t <= nVar && !dead[t] && rooted[t] == 0) return false;
+    }
+    
+    int k = (int)ends.size();
+    part.clear();                                   //отколовшаяся часть
+    if (k > 1) {
+        base = newMarks(k);
+        std::pmr::vector<std::pmr::vector<int>> &queue = scratch->queues;   //узлы, посещенные обходом s; head[s] - первый необработанный
+        std::pmr::vector<int> &parent = scratch->forest;    //объединение пересекшихся обходов
+        if ((int)queue.size() < k) queue.resize(k);
+        head.assign(k, 0);
+        parent.resize(k);
+        active.assign(k, 1);                        //для корня: сколько обходов группы еще идут
+        for (int s = 0; s < k; s++) {
+            parent[s] = s;
+            queue[s].clear();
+            queue[s].push_back(ends[s]);
+            mark[ends[s]] = base + s;
+        }
+        auto findRoot = [&](int s) {
+            while (parent[s] != s) {
+                parent[s] = parent[parent[s]];
+                s = parent[s];
+            }
+            return s;
+        };
+        int groups = k;
+        int closed = -1;                            //группа, чья часть перечислена полностью
+        auto visit = [&](int s, int to) {
+            if (to < 1 || to > nVar) return;
+            if (mark[to] < base || mark[to] >= base + k) {
+                mark[to] = base + s;
+                queue[s].push_back(to);
+                return;
+            }
+            int a = findRoot(s);
+            int b = findRoot(mark[to] - base);
+            if (a == b) return;
+            parent[b] = a;
+            active[a] += active[b];
+            groups--;
+        };
+        while (groups > (closed == -1 ? 1 : 2)) {
+            bool moved = false;
+            for (int s = 0; s < k; s++) {
+                if (head[s] == (int)queue[s].size()) continue;
+                moved = true;
+                int cur = queue[s][head[s]++];
+                visit(s, pos_type1[cur].getLink());
+                visit(s, pos_type2[cur].getLink());
+                for (int from: linkedFrom[cur]) {
+                    visit(s, from);
+                }
+                if (head[s] == (int)queue[s].size() && --active[findRoot(s)] == 0) {
+                    if (closed != -1) return false;         //третья часть
+                    closed = findRoot(s);
+                }
+            }
+            if (!moved) break;
+        }
+        if (closed != -1) {
+            for (int s = 0; s < k; s++) {
+                if (findRoot(s) == closed) part.insert(part.end(), queue[s].begin(), queue[s].end());
+            }
+        }
     }
     
-    std::unordered_set<int> newList;
-    std::unordered_set<int> newVisited;
-    for (int i = 1; i <= nVar; i++) {
-        if (ptr_var[i] == 1) {
-            bypass(i, -1, newList, newVisited);
+    if (part.empty()) {                             //кнф не разделилась
+#ifdef NIR_CHECK_DIVIDE
+        checkLocalSplit(part);
+#endif
+        setFictiousBonds();
+        touched.clear();
+        cutTargets.clear();
+        return true;
+    }
+    if (2 * (int)part.size() >= nVar - nDead) return false;     //при равенстве порядок частей решает полная разметка
+    
+    if (std::none_of(part.begin(), part.end(), [&](int i) { return ptr_var[i] == 1; })) {
+        return false;                               //часть без указателей потеряна, ее разбирает полная разметка
+    }
+#ifdef NIR_CHECK_DIVIDE
+    checkLocalSplit(part);
+#endif
+    for (int i: part) {
+        if (openRows[i] == 1) {
+            openRows.Set0(i);
+            nOpen--;
         }
     }
+    splitOrder(part, scratch->order);
+    newInds.clear();
+    splitOff(cnf.emplace(memory, scratch), scratch->order, newInds);
+    touched.clear();
+    cutTargets.clear();
     
-    //Перестроим фиктивные связи для оставшихся в старой кнф переменных
-    for (int i = 0; i < listsUnique.size(); i++) {
-        if (i != shortInd) {
-            checkFictiousBonds(newList, nFields);
+    setFictiousBonds();
+    cnf->checkFictiousBonds(newInds, nFields);
+    cnf->settle(nFields);
+    
+    if (tombstoneShare * nDead > nVar) compactSlots();
+    return true;
+}
+
+#ifdef NIR_CHECK_DIVIDE
+//Сборка с -DNIR_CHECK_DIVIDE сверяет каждое локальное разделение с полной разметкой: part должна быть
+//одной из двух компонент целиком, а пустая part - означать, что компонента одна. Расхождение - ошибка
+//в учете изменений (touched, cutTargets, linkedFrom), программа завершается
+void CNF::checkLocalSplit(std::span<const int> part) {
+    std::pmr::vector<int> &comp = scratch->comp;
+    std::pmr::vector<int> &sizes = scratch->compSizes;
+    int nComp = labelComponents(comp, sizes);
+    bool ok = part.empty() ? nComp <= 1 : nComp == 2 && sizes[comp[part[0]]] == (int)part.size();
+    for (int i: part) {
+        ok = ok && comp[i] == comp[part[0]];
+    }
+    if (!ok) {
+        std::cerr << "divideLocal: часть из " << part.size() << " узлов, полная разметка - " << nComp
+                  << " компонент" << std::endl;
+        std::abort();
+    }
+}
+#endif
+
+//для разделения кнф: отколовшаяся компонента, если кнф разделилась.
+//Новая кнф создается только при разделении, а рабочие массивы - общие (CNFScratch) - неразделившаяся кнф
+//не выделяет память
+std::optional<CNF> CNF::divide(int nFields) {
+    std::optional<CNF> cnf;
+    if (settled && settledFields == nFields && divideLocal(cnf, nFields)) {
+        return cnf;
+    }
+    std::pmr::vector<int> &comp = scratch->comp;
+    std::pmr::vector<int> &sizes = scratch->compSizes;
+    std::pmr::vector<int> &compNodes = scratch->compNodes;
+    std::pmr::vector<int> &compStart = scratch->compStart;
+    std::pmr::vector<int> &head = scratch->head;
+    std::pmr::vector<int> &newInds = scratch->newInds;
+    std::pmr::vector<int> &newList = scratch->newList;
+    unsettle();
+    int nComp = labelComponents(comp, sizes);
+    
+    if (nComp == 0) {
+        return cnf;
+    }
+    compStart.assign(nComp + 1, 0);                 //узлы компоненты c в порядке ключей - compNodes[compStart[c]..compStart[c+1])
+    for (int c = 0; c < nComp; c++) {
+        compStart[c + 1] = compStart[c] + sizes[c];
+    }
+    compNodes.resize(compStart[nComp]);
+    head.assign(compStart.begin(), compStart.end() - 1);    //куда положить следующий узел компоненты
+    for (int i: keySlot) {
+        if (i >= 1 && comp[i] != -1) compNodes[head[comp[i]]++] = i;
+    }
+    auto nodesOf = [&](int c) {
+        return std::span<const int>(compNodes.data() + compStart[c], sizes[c]);
+    };
+    checkFictiousBonds(nodesOf(0), nFields);
+    if (nComp == 1) {
+        if (sizes[0] == nVar - nDead) settle(nFields);
+        return cnf;
+    }
+    int shortInd = 0;
+    for (int i = 1; i < nComp; i++) {
+        if (sizes[i] < sizes[shortInd]) {
+            shortInd = i;
         }
     }
+    splitOrder(nodesOf(shortInd), scratch->order);
+    newInds.clear();
+    splitOff(cnf.emplace(memory, scratch), scratch->order, newInds);
+    
+    //Оставшиеся компоненты не связаны с перенесенной, поэтому их разметка не изменилась
+    newList.clear();
+    for (int i = 1; i <= nVar; i++) {
+        if (comp[i] != -1 && comp[i] != shortInd) newList.push_back(i);
+    }
+    
+    //Перестроим фиктивные связи для оставшихся в старой кнф переменных
+    checkFictiousBonds(newList, nFields);
     
     //Перестроим фиктивные связи для переменных новой кнф
-    cnf.checkFictiousBonds(newInds, nFields);
+    cnf->checkFictiousBonds(newInds, nFields);
+    cnf->settle(nFields);
+    
+    if (tombstoneShare * nDead > nVar) compactSlots();
+    if (nComp == 2 && (int)newList.size() == nVar - nDead) settle(nFields);
     
     return cnf;
 }
 
 //добаление участка памяти в кнф
-void CNF::addAlMem(std::string nameIn, int indFrom, int type=1) {
-    var_names.push_back(nameIn);
+void CNF::addAlMem(Symbol nameIn, int indFrom, int type=1) {
+    addName(nameIn);
     
     resizeB(nVar+1);
+    noteRowChange(indFrom);
+    noteNewNode(nVar);
     
-    BoolVector allZ(nVar);
     if (type == 1) {                                        //если node->next = malloc или node = malloc
-        pos_type1[indFrom] = pos_type1[indFrom] & allZ;                         //удаляем старую связь из узла с индексом indFrom
+        pos_type1[indFrom].Clear();                         //удаляем старую связь из узла с индексом indFrom
         pos_type1[indFrom].Set1(nVar);
     } else {                                                //если node->prev = malloc
         neg[pos_type1[indFrom].getLinkZeroIncluded()].Set0(indFrom);
-        pos_type2[indFrom] = pos_type2[indFrom] & allZ;
+        pos_type2[indFrom].Clear();
         pos_type2[indFrom].Set1(nVar);
     }
     
     neg[nVar].Set1(indFrom);
+    updateRooted();
 }
 
 //добавление переменной-указателей    случай node* var; (объявление без инициализации)
-void CNF::addPtrVar(std::string name, int nFields) {
-    var_names.push_back(name);
+void CNF::addPtrVar(Symbol name, int nFields) {
+    addName(name);
     resizeB(nVar+1);
+    noteNewNode(nVar);
     if (nFields == 2) {
         pos_type2[1].Set1(0);
     }
     ptr_var.Set1(1);
+    updateRooted();
 }
 
 //добавление null
 void CNF::addNULL(int indOut, int type = 1) {
+    noteRowChange(indOut);
     if (type == 1) {             //var = null; или var->next = null;
         int prevLink = pos_type1[indOut].getLinkZeroIncluded();   //ищем предыдущую связь
         if (prevLink > 0){
@@ -950,22 +3065,26 @@ void CNF::addNULL(int indOut, int type = 1) {
         pos_type2[indOut].Set1(0);
     }
     neg[0].Set1(indOut);
+    updateRooted();
 }
 
 
-void CNF::point(int& ind, std::string nameOut, int& type) {       //var = ...(только если левая часть не имеет полей)
-    var_names.push_back(nameOut);
+void CNF::point(int& ind, Symbol nameOut) {                  //var = ...(только если левая часть не имеет полей)
+    addName(nameOut);
     resizeB(nVar+1);
+    noteNewNode(nVar);
     
     pos_type1[nVar] = pos_type1[ind];
     pos_type2[nVar] = pos_type2[ind];
     neg[pos_type1[nVar].getLink()].Set1(nVar);
     
     ptr_var.Set1(nVar);
+    updateRooted();
 }
 
 //переопредение связей
 void CNF::rePoint(int& ind, int& out, int& type, int& nFields) {
+    noteRowChange(out);
     int prevLink;
     if (type == 1) {
         prevLink = pos_type1[out].getLinkZeroIncluded();   //ищем предыдущую связь
@@ -993,15 +3112,15 @@ void CNF::rePoint(int& ind, int& out, int& type, int& nFields) {
         pos_type2[out] = pos_type1[ind];
         neg[pos_type2[out].getLink()].Set1(out);
     }
+    updateRooted();
 }
 
 //для проверки, указывает ли объект на что-либо
 bool CNF::isDangling(int& ind, int type=1) {
-    BoolVector allZ(nVar);
     if (type == 1) {
-        if (pos_type1[ind] == allZ) return true;
+        if (!pos_type1[ind].hasWeight()) return true;
     } else {
-        if (pos_type2[ind] == allZ) return true;
+        if (!pos_type2[ind].hasWeight()) return true;
     }
     
     return false;
@@ -1016,132 +3135,389 @@ bool CNF::pointsAtNULL(int& ind, int type = 1) {
 
 //проверка, если в кнф переменные
 bool CNF::isEmpty() {
-    if (nVar == 0) return true;
+    if (nVar - nDead == 0) return true;
     return false;
 }
 
 //удалить связь
 void CNF::makeDangling(int& ind, int fieldType=1) {
-    BoolVector allZ(nVar+1);
+    noteRowChange(ind);
     if (fieldType == 1) {
-        pos_type1[ind] = pos_type1[ind] & allZ;
+        pos_type1[ind].Clear();
     } else {
-        pos_type2[ind] = pos_type2[ind] & allZ;
-    }
-    for (int i = 1; i <= nVar; i++) {
-        if (pos_type1[0][i]) {
-            pos_type1[0].Set0(i);
-            neg[i].Set0(0);
-        }
+        pos_type2[ind].Clear();
+    }
+    //убираем все фиктивные связи из null, связь null в самого себя (бит 0) оставляем
+    bool nullToNull = pos_type1[0][0] == 1;
+    pos_type1[0].forEachSetBit([&](int i) {
+        if (i >= 1) neg[i].Set0(0);
+    });
+    pos_type1[0].Clear();
+    if (nullToNull) pos_type1[0].Set1(0);
+    updateRooted();
+}
+
+//bypass без рекурсии: добавляет в list ключи key(i) узлов, достижимых из start, в том же порядке, что и
+//рекурсивный bypass, - узел, затем все за next, затем все за prev. Стек дает этот прямой порядок: prev
+//кладется раньше next и снимается, когда все за next уже обойдено; посещенный узел пропускается
+template<class Key>
+void CNF::bypassKeys(int start, Key&& key, std::unordered_set<int>& list) {
+    std::pmr::vector<int> &stack = scratch->walk;
+    stack.assign(1, start);
+    while (!stack.empty()) {
+        int cur = stack.back();
+        stack.pop_back();
+        if (!list.insert(key(cur)).second) continue;
+        int next = pos_type1[cur].getLink();
+        int pr = pos_type2[cur].getLink();
+        if (pr != -1) stack.push_back(pr);
+        if (next != -1) stack.push_back(next);
     }
 }
 
-//слияние кнф
-void CNF::merge(CNF& right, int& from, int& to, int fieldType = 1) {
+//Порядок, в котором merge переносит узлы этой (правой) кнф. Прежде merge обходил правую кнф bypass от
+//каждой переменной-указателя по порядку индексов, складывал индексы в один std::unordered_set и переносил
+//узлы в порядке его итерации. От этого порядка зависят номера перенесенных узлов в выводе, а через них -
+//выбор части при равных размерах в следующих divide, поэтому он сохранен: множество строится из тех же
+//чисел - номеров узлов в порядке ключей, какими были индексы уплотненной кнф, - теми же вставками.
+//Узлы множества - это rooted
+void CNF::mergeOrder(std::pmr::vector<int>& order) {
+    std::pmr::vector<int> &rank = scratch->rank;
+    std::pmr::vector<int> &rankSlot = scratch->rankSlot;
+    keyRanks(rank);
+    rankSlot.clear();
+    forEachLiveInOrder([&](int i) { rankSlot.push_back(i); });
     std::unordered_set<int> list;
-    std::unordered_set<int> visited;                //обходим список, так как в правой кнф могут быть потерянные узлы, которые при обходе не войдут в список
-    for (int i = 1; i <= right.nVar; i++) {         //для переноса
-        if (right.ptr_var[i] == 1) {
-            right.bypass(i, -1, list, visited);
-        }
+    for (int i: rankSlot) {
+        if (ptr_var[i] == 1) bypassKeys(i, [&](int j) { return rank[j]; }, list);
     }
+    order.clear();
+    for (int r: list) order.push_back(rankSlot[r]);
+}
+
+//Переносим в конец этой кнф узлы src из list (в этом порядке) вместе со связями между ними;
+//oldToNew - новые индексы. Связи копируются по единичным битам строк, связи вне list отбрасываются
+void CNF::takeNodes(CNF& src, std::span<const int> list, std::pmr::vector<int>& oldToNew) {
     int size = (int)list.size();
     resizeB(nVar+size);
-    std::vector<int> oldToNew(right.nVar+1, -1);             //соотношение старых индексов в старой кнф с новыми индексами в новой
-    std::unordered_set<int> newInds;
+    oldToNew.assign(src.nVar+1, -1);
     
     int newInd = nVar - size + 1;
     
-    std::unordered_set<std::string> namesToDel;
-    
     for (int oldInd: list) {                                    //определяем соотношение старых-новых индексов
         oldToNew[oldInd] = newInd;
-        std::string name = right.var_names[oldInd];
-        var_names.push_back(name);
-        if (right.ptr_var[oldInd] == 1) ptr_var.Set1(newInd);
-        newInds.insert(newInd);
+        addName(src.var_names[oldInd]);
+        if (src.ptr_var[oldInd] == 1) ptr_var.Set1(newInd);
+        if (src.rooted[oldInd] == 1) rooted.Set1(newInd);       //достижимость переносится вместе с узлами и связями
         newInd++;
-        
-        namesToDel.insert(name);
     }
     
     for (int oldFrom: list) {                               //переносим связи
         int newFrom = oldToNew[oldFrom];
-        for (int oldTo: list) {
-            int newTo = oldToNew[oldTo];
-            
-            if (right.pos_type1[oldFrom][oldTo] == 1) {
-                pos_type1[newFrom].Set1(newTo);
-            }
-            if (right.pos_type2[oldFrom][oldTo] == 1) {
-                pos_type2[newFrom].Set1(newTo);
-            }
-            if (right.neg[oldFrom][oldTo] == 1) {
-                neg[newFrom].Set1(newTo);
-            }
-        }
-        if (right.pos_type1[oldFrom][0] == 1){
+        src.pos_type1[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= src.nVar && oldToNew[oldTo] != -1) pos_type1[newFrom].Set1(oldToNew[oldTo]);
+        });
+        src.pos_type2[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= src.nVar && oldToNew[oldTo] != -1) pos_type2[newFrom].Set1(oldToNew[oldTo]);
+        });
+        src.neg[oldFrom].forEachSetBit([&](int oldTo) {
+            if (oldTo <= src.nVar && oldToNew[oldTo] != -1) neg[newFrom].Set1(oldToNew[oldTo]);
+        });
+        if (src.pos_type1[oldFrom][0] == 1){
             pos_type1[newFrom].Set1(0);
             neg[0].Set1(newFrom);
         }
-        if (right.pos_type2[oldFrom][0] == 1){
+        if (src.pos_type2[oldFrom][0] == 1){
             pos_type2[newFrom].Set1(0);
             neg[0].Set1(newFrom);
         }
     }
-    
-    
-    for (std::string name: namesToDel) {        //удаляем объекты из старой кнф
-        right.deleteNode(name);
+    for (int i = nVar - size + 1; i <= nVar; i++) {
+        addLinksFrom(i);
     }
+}
+
+//слияние кнф: узлы меньшей переносятся в большую, индексы большей не меняются.
+//Переносится только достижимое из переменных-указателей правой кнф (rooted) в порядке mergeOrder.
+//Если правая кнф больше и потерянных узлов в ней нет, кнф обмениваются содержимым (вместе с номерами,
+//см. CNFList::merge), и в нее переносятся все узлы левой; по большей кнф проходит только проверка
+//связей в null, без копирования строк. Узлы левой при этом встают в конец слотов, а ключи расставляются
+//заново - как после обычного переноса: узлы левой в прежнем порядке, за ними узлы правой в порядке mergeOrder. Опустевшая правая кнф пересоздается целиком, без удаления узлов по одному
+void CNF::merge(CNF& right, int& from, int& to, int fieldType = 1) {
+    unsettle();                                     //слияние меняет слишком много строк для локальной проверки
+    right.unsettle();
+    int size = right.rooted.getWeight();
+    bool whole = size == right.nVar - right.nDead;  //правая кнф переносится целиком
+    std::pmr::vector<int> oldToNew(memory);         //соотношение старых индексов в перенесенной кнф с новыми
+    
+    if (whole && size > nVar - nDead) {
+        std::swap(*this, right);
+        //Результат должен совпасть с переносом правой кнф в левую: у узлов правой связи в null (neg[0])
+        //строятся заново по их строкам, узлы левой сохраняют свои, а строки null берутся от левой
+        const CNF &big = *this;                     //чтение строк не должно отделять общие куски
+        for (int i = 1; i <= nVar; i++) {
+            if (dead[i]) continue;
+            bool toNull = big.pos_type1[i][0] == 1 || big.pos_type2[i][0] == 1;
+            if (toNull != (big.neg[0][i] == 1)) {
+                if (toNull) neg[0].Set1(i);
+                else neg[0].Set0(i);
+            }
+        }
+        auto copyNullBit = [](auto &&to, const auto &src) {
+            if (src[0] == 1) to.Set1(0);
+            else to.Set0(0);
+        };
+        copyNullBit(pos_type1[0], right.pos_type1[0]);
+        copyNullBit(pos_type2[0], right.pos_type2[0]);
+        copyNullBit(neg[0], right.neg[0]);
+        
+        std::pmr::vector<int> &bigOrder = scratch->newList;
+        mergeOrder(bigOrder);                       //порядок, в котором узлы большей перенес бы обычный merge
+        std::pmr::vector<int> &list = scratch->order;   //все живые узлы бывшей левой кнф, в порядке ключей
+        list.clear();
+        right.forEachLiveInOrder([&](int i) {
+            if (i != 0) list.push_back(i);
+        });
+        takeNodes(right, list, oldToNew);
+        for (int oldInd: list) {
+            if (right.neg[0][oldInd] == 1) neg[0].Set1(oldToNew[oldInd]);
+            else neg[0].Set0(oldToNew[oldInd]);
+        }
+        keySlot.resize(1);
+        for (int oldInd: list) keySlot.push_back(oldToNew[oldInd]);
+        for (int i: bigOrder) keySlot.push_back(i);
+        slotKey.assign(nVar + 1, -1);
+        for (int k = 0; k < (int)keySlot.size(); k++) slotKey[keySlot[k]] = k;
+        for (int k = (int)list.size(); k > 0; k--) {    //при повторе имени первым теперь идет узел левой
+            nameToSlot[var_names[keySlot[k]]] = keySlot[k];
+        }
+        from = oldToNew[from];
+    } else {
+        to = right.compactSlots(to);                //порядок переноса зависит от индексов правой кнф
+        std::pmr::vector<int> &list = scratch->order;
+        right.mergeOrder(list);
+        takeNodes(right, list, oldToNew);
+        to = oldToNew[to];
+        if (!whole) {
+            for (int oldInd: list) {                    //удаляем объекты из старой кнф
+                right.eraseSlot(oldInd, false);
+            }
+            if (tombstoneShare * right.nDead > right.nVar) right.compactSlots();
+        }
+    }
+    if (whole) right = CNF(right.memory, right.scratch);
     
-    int newTo = oldToNew[to];
-    
+    noteRowChange(from);
     if (fieldType == 1) {             //если var = .. или var->next = ..
         neg[0].Set0(from);
-        pos_type1[from] = pos_type1[newTo];
+        pos_type1[from] = pos_type1[to];
         neg[pos_type1[from].getLink()].Set1(from);
     } else {                          //если var->prev = ..
         neg[0].Set0(from);
-        pos_type2[from] = pos_type1[newTo];
+        pos_type2[from] = pos_type1[to];
         neg[pos_type2[from].getLink()].Set1(from);
     }
-    
-    
+    updateRooted();
 }
 
-//поиск объекта по имени: индекс кнф, в котором он находится и индекс объекта
-std::pair<int, int> find(std::vector<CNF>& CNFcontainer, std::string name){
-    for (int i = 0; i < CNFcontainer.size(); i++) {
-        int varIndex = CNFcontainer[i].findVarIndex(name);
-        if (varIndex != -1) {
-            return {i, varIndex};
+//Хэндл компоненты в CNFList: слот и его поколение. Хэндл не меняется, пока компонента в списке,
+//что бы ни добавлялось и ни удалялось вокруг; после удаления компоненты поколение слота растет,
+//и старый хэндл перестает быть действительным (contains вернет false)
+struct CNFHandle {
+    int slot = -1;
+    unsigned generation = 0;
+    
+    bool valid() const {
+        return slot != -1;
+    }
+    bool operator == (const CNFHandle &other) const = default;
+};
+
+//Список кнф-компонент - слот-карта. Кнф лежат в items в порядке добавления, хэндл ведет к позиции
+//через slotPos. Удаление оставляет пустое место (как удаленные узлы в CNF), так что порядок
+//компонент сохраняется, а места вырезаются разом при уплотнении. Свой индекс имен (NameLocations)
+//позволяет искать объект по имени, не перебирая компоненты.
+class CNFList {
+private:
+    static constexpr int tombstoneShare = 4;
+    
+    std::pmr::memory_resource *memory;  //из него создаются новые кнф
+    std::pmr::vector<CNF> items;
+    std::pmr::vector<int> itemSlot;     //позиция в items -> слот, -1 - место удаленной кнф
+    std::pmr::vector<int> slotPos;      //слот -> позиция в items, -1 - слот свободен
+    std::pmr::vector<unsigned> generation;
+    std::pmr::vector<int> freeSlots;
+    std::pmr::vector<int> slotOfId;     //номер кнф (CNF::getId) -> слот
+    NameLocations names;                //имя -> номер кнф, в которой оно лежит
+    CNFScratch scratch;                 //рабочие массивы обходов, общие для всех кнф списка
+    int nDead = 0;
+    
+    CNFHandle handleOf(int slot) const {
+        return {slot, generation[slot]};
+    }
+    
+    CNFHandle place(CNF&& cnf) {
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = (int)slotPos.size();
+            slotPos.push_back(-1);
+            generation.push_back(0);
+        }
+        slotPos[slot] = (int)items.size();
+        itemSlot.push_back(slot);
+        items.push_back(std::move(cnf));
+        items.back().attach(&names, &scratch);
+        int cnfId = items.back().getId();
+        if (cnfId >= (int)slotOfId.size()) slotOfId.resize(cnfId + 1, -1);
+        slotOfId[cnfId] = slot;
+        return handleOf(slot);
+    }
+    
+    //вырезает места удаленных кнф, сохраняя порядок остальных
+    void compact() {
+        int k = 0;
+        for (int pos = 0; pos < (int)items.size(); pos++) {
+            if (itemSlot[pos] == -1) continue;
+            if (k != pos) {
+                items[k] = std::move(items[pos]);
+                itemSlot[k] = itemSlot[pos];
+            }
+            slotPos[itemSlot[k]] = k;
+            k++;
+        }
+        items.erase(items.begin() + k, items.end());
+        itemSlot.resize(k);
+        nDead = 0;
+    }
+    
+public:
+    explicit CNFList(std::pmr::memory_resource *res = std::pmr::get_default_resource())
+        : memory(res), items(res), itemSlot(res), slotPos(res), generation(res), freeSlots(res), slotOfId(res), scratch(res) {}
+    CNFList(const CNFList&) = delete;                //кнф держат указатели на names и scratch
+    CNFList& operator=(const CNFList&) = delete;
+    
+    CNF& operator[](CNFHandle h) {
+        return items[slotPos[h.slot]];
+    }
+    std::pmr::memory_resource* resource() const {
+        return memory;
+    }
+    bool contains(CNFHandle h) const {
+        return h.slot >= 0 && h.slot < (int)slotPos.size() && slotPos[h.slot] != -1 && generation[h.slot] == h.generation;
+    }
+    int size() const {
+        return (int)items.size() - nDead;
+    }
+    
+    CNFHandle emplace() {
+        return place(CNF(memory, &scratch));
+    }
+    CNFHandle push_back(CNF&& cnf) {
+        return place(std::move(cnf));
+    }
+    void erase(CNFHandle h) {
+        int pos = slotPos[h.slot];
+        slotOfId[items[pos].getId()] = -1;
+        CNF removed = std::move(items[pos]);                 //память кнф освобождается сразу, место - при уплотнении
+        itemSlot[pos] = -1;
+        slotPos[h.slot] = -1;
+        generation[h.slot]++;
+        freeSlots.push_back(h.slot);
+        nDead++;
+        if (tombstoneShare * nDead > (int)items.size()) compact();
+    }
+    
+    //слияние компоненты right в into (CNF::merge). Кнф при этом могут обменяться содержимым вместе
+    //с номерами, а опустевшая right получает новый номер вне списка - переназначаем номера обоих слотов
+    void merge(CNFHandle into, CNFHandle right, int& from, int& to, int fieldType) {
+        slotOfId[(*this)[into].getId()] = -1;
+        slotOfId[(*this)[right].getId()] = -1;
+        (*this)[into].merge((*this)[right], from, to, fieldType);
+        for (CNFHandle h: {into, right}) {
+            (*this)[h].attach(&names, &scratch);
+            int cnfId = (*this)[h].getId();
+            if (cnfId >= (int)slotOfId.size()) slotOfId.resize(cnfId + 1, -1);
+            slotOfId[cnfId] = h.slot;
+        }
+    }
+    
+    //все компоненты подряд в порядке добавления
+    std::span<CNF> components() {
+        if (nDead > 0) compact();
+        return std::span<CNF>(items);
+    }
+    //то же без уплотнения: места удаленных кнф пропускаются, список не меняется
+    template<class F>
+    void forEachComponent(F &&f) const {
+        for (int pos = 0; pos < (int)items.size(); pos++) {
+            if (itemSlot[pos] != -1) f(items[pos]);
         }
     }
-    return {-1, -1};
+    
+    //поиск объекта по имени: хэндл кнф, в которой он находится, и индекс объекта
+    std::pair<CNFHandle, int> find(Symbol name) {
+        int cnfId = names.ownerOf(name);
+        if (cnfId == -1 || cnfId >= (int)slotOfId.size() || slotOfId[cnfId] == -1) return {CNFHandle(), -1};
+        CNFHandle h = handleOf(slotOfId[cnfId]);
+        return {h, (*this)[h].findVarIndex(name)};
+    }
+    
+    //потерян ли сейчас объект с таким именем; неизвестное имя потерянным не считается
+    bool isLeaked(Symbol name) {
+        std::pair<CNFHandle, int> ind = find(name);
+        return ind.first.valid() && (*this)[ind.first].isLeaked(ind.second);
+    }
+};
+
+#ifdef NIR_COUNT_ALLOCS
+//отпечаток состава компонент: номера кнф и число узлов в каждой. Событие, которое его не меняет
+//(не создает, не сливает и не делит компоненты, не добавляет и не переносит узлы), считается устоявшимся
+//Только читает список: измерение не должно уплотнять его само, иначе проверка меняет то, что проверяет
+static std::uint64_t componentShape(const CNFList& CNFcontainer) {
+    std::uint64_t shape = 0;
+    CNFcontainer.forEachComponent([&](const CNF& cnf) {
+        shape = shape * 1000003 + ((std::uint64_t)cnf.getId() << 32 | (std::uint32_t)cnf.get_nVar());
+    });
+    return shape;
 }
+#endif
 
 //обработка json-файла, алгоритм формирования булевой таблицы кнф
-void makeBoolLinks(const json& parsedJSON, std::vector<CNF>& CNFcontainer, const std::vector<std::string>& fields, std::unordered_map<std::string, int>& nameToIdTable) {
+void makeBoolLinks(const json& parsedJSON, CNFList& CNFcontainer, const std::vector<std::string>& fields, std::unordered_map<Symbol, int>& nameToIdTable) {
     int nFields = (int)fields.size();
-    
-    for (int i = 1; i < parsedJSON.size(); i++) {
+    //строки трассы читаем по ссылке (get_ref) и не сравниваем json со строками напрямую -
+    //иначе на каждом событии создаются временные строки и json-значения
+    static const std::string noValue;
+    const int ptrSlot[] = {1};          //единственная переменная-указатель новой кнф
+#ifdef NIR_COUNT_ALLOCS
+    eventAllocations().assign(parsedJSON.size(), {});    //заранее, чтобы запись счетчика сама не выделяла память
+#endif
+    
+    for (int i = 1; i < (int)parsedJSON.size(); i++) {
+#ifdef NIR_COUNT_ALLOCS
+        std::uint64_t shapeBefore = componentShape(CNFcontainer);
+        std::size_t allocsBefore = allocations();
+#endif
     //for (int i = 1; i < 25; i++) {               //стоппер для проверки промежуточных значений
     //    if (i == 25) {
     //        std::cout<<"i"<<std::endl;
     //    }
         //Найдем индекс кнф, в которой находится переменная с которой мы работаем, индекс этой переменной
         //Если переменной с таким именем нет вернём {-1, -1}
-        std::pair<int, int> varInd = find(CNFcontainer, parsedJSON[i]["name"]);
+        Symbol var = symbols().intern(parsedJSON[i]["name"].get_ref<const std::string&>());        //строки из трассы сразу переводим в символы
+        std::pair<CNFHandle, int> varInd = CNFcontainer.find(var);
         int type = 1;     //тип поля с которым мы работаем - 1 для указателей и поля next, 2 для поля prev
         
         //var->NODE1->(next) NODE2
         //если нет обращения к полю мы работаем с var(определяем связи для неё, меняя первую стрелку)
         //если есть обращение к полю работаем с NODE1 и определяем связи для неё, меняя вторую стрелку
         
-        std::string name = parsedJSON[i]["name"];
+        Symbol name = var;
         if (parsedJSON[i].contains("f")) {                    //если есть обращение к полю, ищем индекс NODE1
-            if (nFields == 2 && parsedJSON[i]["f"] == fields[1]){
+            if (nFields == 2 && parsedJSON[i]["f"].get_ref<const std::string&>() == fields[1]){
                 type = 2;
             }
             varInd.second = CNFcontainer[varInd.first].findFieldInd(varInd.second);
@@ -1150,81 +3526,74 @@ void makeBoolLinks(const json& parsedJSON, std::vector<CNF>& CNFcontainer, const
         
         //добавляем в таблицу соответствий имя переменной и номер строки кода
         nameToIdTable[name] = parsedJSON[i]["id"];
-        if (varInd.first != -1) {
+        if (varInd.first.valid()) {
             int next = CNFcontainer[varInd.first].getUnsafeLink(varInd.second, type);  //найдем на какой узел ссылается переменная, с которой мы работаем, потому что у нас есть возможность потерять этот узел
             if (next != -1) {
                 nameToIdTable[CNFcontainer[varInd.first].get_varName(next)] = parsedJSON[i]["id"]; //перезапишем номер строки для узла
             }
         }
         
-        std::string value;
-        if (parsedJSON[i].contains("value") && !parsedJSON[i]["value"].is_structured()) { //если правая часть var/null
-            value = parsedJSON[i]["value"];
-        }
+        const std::string& value = parsedJSON[i].contains("value") && !parsedJSON[i]["value"].is_structured()
+                                   ? parsedJSON[i]["value"].get_ref<const std::string&>() : noValue;   //если правая часть var/null
         
         if (parsedJSON[i].contains("op") && CNFcontainer[varInd.first].get_nVar() > 1) { //free
-            std::vector<CNF> danglingPointers;
+            std::pmr::vector<CNF> danglingPointers(CNFcontainer.resource());
             //удаляем узел
             CNFcontainer[varInd.first].freeNode(varInd.second, danglingPointers, nFields, type);
             //если остались висячие указатели - переносим их по разным новым кнф(они будут единственными объектами)
-            for (int i = 0; i < danglingPointers.size(); i++) {
-                CNFcontainer.push_back(danglingPointers[i]);
+            for (int i = 0; i < (int)danglingPointers.size(); i++) {
+                CNFcontainer.push_back(std::move(danglingPointers[i]));
             }
             //удаляем висячие указатели из старой кнф
             if (CNFcontainer[varInd.first].get_nVar() == 0) {
-                CNFcontainer.erase(CNFcontainer.begin() + varInd.first);
+                CNFcontainer.erase(varInd.first);
             } else {
-                CNF nCnf = CNFcontainer[varInd.first].divide(nFields);
-                if (nCnf.get_nVar() > 0) CNFcontainer.push_back(nCnf);
+                std::optional<CNF> nCnf = CNFcontainer[varInd.first].divide(nFields);
+                if (nCnf) CNFcontainer.push_back(std::move(*nCnf));
             }
 
         } else if (!parsedJSON[i].contains("value")) {     //node* var;
-            CNF nCnf;
-            nCnf.addPtrVar(parsedJSON[i]["name"], nFields);
-            CNFcontainer.push_back(nCnf);
+            CNF& nCnf = CNFcontainer[CNFcontainer.emplace()];
+            nCnf.addPtrVar(var, nFields);
             
-        } else if (parsedJSON[i]["value"] == "NULL") {          //var = NULL;
-            if (varInd.first == -1 && varInd.second == -1) {    //если имени переменной не содержится ни в одной кнф
-                CNF nCnf;
-                nCnf.addPtrVar(parsedJSON[i]["name"], nFields);   //создаем новую
+        } else if (value == "NULL") {                            //var = NULL;
+            if (!varInd.first.valid() && varInd.second == -1) {    //если имени переменной не содержится ни в одной кнф
+                CNF& nCnf = CNFcontainer[CNFcontainer.emplace()];
+                nCnf.addPtrVar(var, nFields);   //создаем новую
                 nCnf.addNULL(1);                                    //указываем на null
-                std::unordered_set<int> list;
-                list.insert(1);
-                nCnf.checkFictiousBonds(list, nFields);             //проводим фиктивные связи
-                CNFcontainer.push_back(nCnf);
+                nCnf.checkFictiousBonds(ptrSlot, nFields);             //проводим фиктивные связи
             } else {
                 CNFcontainer[varInd.first].addNULL(varInd.second, type);    //если есть указываем на null
-                CNF nCnf = CNFcontainer[varInd.first].divide(nFields);      //разделяем
-                if (nCnf.get_nVar() > 0) CNFcontainer.push_back(nCnf);      //если разделять нечего - nCnf окажется пустой
+                std::optional<CNF> nCnf = CNFcontainer[varInd.first].divide(nFields);      //разделяем
+                if (nCnf) CNFcontainer.push_back(std::move(*nCnf));      //если разделять нечего - nCnf окажется пустой
             }
         } else if (value[0] == 'N') {                            //если значение - выделенная память (в моем формате json'а память N1, N2 и тд)
-            if (varInd.first == -1 && varInd.second == -1) {     //node* var = malloc;
-                CNF nCnf;
-                nCnf.addPtrVar(parsedJSON[i]["name"], nFields);   //создаем новую кнф
-                nCnf.addAlMem(parsedJSON[i]["value"], 1, type);   //заносим узел
-                CNFcontainer.push_back(nCnf);
+            if (!varInd.first.valid() && varInd.second == -1) {     //node* var = malloc;
+                CNF& nCnf = CNFcontainer[CNFcontainer.emplace()];
+                nCnf.addPtrVar(var, nFields);   //создаем новую кнф
+                nCnf.addAlMem(symbols().intern(value), 1, type);   //заносим узел
             } else {
-                CNFcontainer[varInd.first].addAlMem(parsedJSON[i]["value"], varInd.second, type);  //добавляем узел к кнф указателя
-                CNF nCnf = CNFcontainer[varInd.first].divide(nFields);               //разделяем, там же переопределяются фиктивне связи
-                if (nCnf.get_nVar() > 0) CNFcontainer.push_back(nCnf);
+                CNFcontainer[varInd.first].addAlMem(symbols().intern(value), varInd.second, type);  //добавляем узел к кнф указателя
+                std::optional<CNF> nCnf = CNFcontainer[varInd.first].divide(nFields);               //разделяем, там же переопределяются фиктивне связи
+                if (nCnf) CNFcontainer.push_back(std::move(*nCnf));
             }
-            nameToIdTable[value] = parsedJSON[i]["id"]; //Добавим новый узел в таблицу соответствий
+            nameToIdTable[symbols().intern(value)] = parsedJSON[i]["id"]; //Добавим новый узел в таблицу соответствий
         } else {
-            std::pair<int, int> varInd2; //не может быть {-1, -1}, иначе исходный код не скомпилируется
+            std::pair<CNFHandle, int> varInd2; //не может быть {-1, -1}, иначе исходный код не скомпилируется
             int type2 = 1;   //тип обращения к объекту для правой части
-            std::string name2;
+            Symbol name2;
             if (parsedJSON[i]["value"].is_structured()) {                         //если .. = var->next / .. = var->prev
                 //var->Node1->Node2
                 //когда работаем с правой частью мы ссылаемся на узел, а на на переменную, поэтому при ..=var мы работаем не с индексом var, а с индексом Node1
-                varInd2 = find(CNFcontainer, parsedJSON[i]["value"]["name"]);
-                if (nFields == 2 && parsedJSON[i]["value"]["f"] == fields[1]){
+                varInd2 = CNFcontainer.find(symbols().intern(parsedJSON[i]["value"]["name"].get_ref<const std::string&>()));
+                if (nFields == 2 && parsedJSON[i]["value"]["f"].get_ref<const std::string&>() == fields[1]){
                     type2 = 2;
                 }
                 //а если .. = var->next мы работаем с индексом Node2
                 varInd2.second = CNFcontainer[varInd2.first].findFieldInd(varInd2.second);
                 name2 = CNFcontainer[varInd2.first].get_varName(varInd2.second);
             } else {
-                varInd2 = find(CNFcontainer, parsedJSON[i]["value"]);
+                varInd2 = CNFcontainer.find(symbols().intern(value));
                 name2 = CNFcontainer[varInd2.first].get_varName(varInd2.second);
             }
             
@@ -1237,34 +3606,28 @@ void makeBoolLinks(const json& parsedJSON, std::vector<CNF>& CNFcontainer, const
                         
             if (!parsedJSON[i].contains("f")) {       //если var = ..
                 if (CNFcontainer[varInd2.first].pointsAtNULL(varInd2.second, type2)) { //Например, var = var2->next             var2->node->null
-                    if (varInd.first == -1 || CNFcontainer[varInd.first].get_nVar() > 1) {
-                        if (varInd.first != -1 && CNFcontainer[varInd.first].get_nVar() > 1) {
+                    if (!varInd.first.valid() || CNFcontainer[varInd.first].get_nVar() > 1) {
+                        if (varInd.first.valid() && CNFcontainer[varInd.first].get_nVar() > 1) {
                             CNFcontainer[varInd.first].deleteNode(name);       //если левая часть есть в какой-то кнф, удаляем её из этой кнф
                         }
-                        CNF nCnf;
-                        nCnf.addPtrVar(parsedJSON[i]["name"], nFields);
-                        CNFcontainer.push_back(nCnf);
-                        varInd.first = (int)CNFcontainer.size()-1;
+                        varInd.first = CNFcontainer.emplace();
+                        CNFcontainer[varInd.first].addPtrVar(var, nFields);
                         varInd.second = 1;
                     }
                     if (!CNFcontainer[varInd.first].pointsAtNULL(varInd.second, type)) { //если левая часть не показывает на null
                         CNFcontainer[varInd.first].addNULL(varInd.second, type2);
-                        std::unordered_set<int> list;
-                        list.insert(1);
-                        CNFcontainer[varInd.first].checkFictiousBonds(list, nFields);
+                        CNFcontainer[varInd.first].checkFictiousBonds(ptrSlot, nFields);
                     }
                     //если левая тоже указывает на null, то пропускаем
                     
                 } else if (CNFcontainer[varInd2.first].isDangling(varInd2.second)) {  //если var = var2       var2->node->
                     //если правая часть висячий указатель
-                    if (varInd.first == -1 || CNFcontainer[varInd.first].get_nVar() > 1) {
-                        if (varInd.first != -1 && CNFcontainer[varInd.first].get_nVar() > 1) {
+                    if (!varInd.first.valid() || CNFcontainer[varInd.first].get_nVar() > 1) {
+                        if (varInd.first.valid() && CNFcontainer[varInd.first].get_nVar() > 1) {
                             CNFcontainer[varInd.first].deleteNode(name);                            //удаляем левый из старой кнф
                         }
-                        CNF nCnf;
-                        nCnf.addPtrVar(parsedJSON[i]["name"], 1);                //переносим указатель в новую кнф
-                        CNFcontainer.push_back(nCnf);
-                        varInd.first = (int)CNFcontainer.size()-1;
+                        varInd.first = CNFcontainer.emplace();
+                        CNFcontainer[varInd.first].addPtrVar(var, 1);                //переносим указатель в новую кнф
                         varInd.second = 1;
                     }
                     if (!CNFcontainer[varInd.first].isDangling(varInd.second, type)) {    //var-> null
@@ -1278,12 +3641,12 @@ void makeBoolLinks(const json& parsedJSON, std::vector<CNF>& CNFcontainer, const
                         CNFcontainer[varInd2.first].rePoint(varInd2.second, varInd.second, type, nFields); //переносим связь
                     }
                     else {     //если в разных
-                        CNFcontainer[varInd2.first].point(varInd2.second, name, type);        //добавляем указатель в кнф правой части
-                        if (varInd.first != -1) {
+                        CNFcontainer[varInd2.first].point(varInd2.second, name);              //добавляем указатель в кнф правой части
+                        if (varInd.first.valid()) {
                             CNFcontainer[varInd.first].deleteNode(name);                       //удаляем из старой кнф и разделяем
-                            CNF nCnf = CNFcontainer[varInd2.first].divide(nFields);
+                            CNFcontainer[varInd2.first].divide(nFields);
                             if (CNFcontainer[varInd.first].get_nVar() == 0) {
-                                CNFcontainer.erase(CNFcontainer.begin() + varInd.first);       //если старая кнф осталсь пустой, удаляем её
+                                CNFcontainer.erase(varInd.first);       //если старая кнф осталсь пустой, удаляем её
                             }
                         }
                     }
@@ -1295,41 +3658,53 @@ void makeBoolLinks(const json& parsedJSON, std::vector<CNF>& CNFcontainer, const
                 } else if (CNFcontainer[varInd2.first].isDangling(varInd2.second, type)) {      //var2->    или var2->node->
                     CNFcontainer[varInd.first].makeDangling(varInd.second, type);
                 } else if (varInd.first != varInd2.first){          //левая и правая часть в разных кнф  и var2->node или var2->node->node1
-                    CNFcontainer[varInd.first].merge(CNFcontainer[varInd2.first], varInd.second, varInd2.second, type);
+                    CNFcontainer.merge(varInd.first, varInd2.first, varInd.second, varInd2.second, type);
                 } else {                                            //в одной кнф   и var2->node или var2->node->node1
                     CNFcontainer[varInd2.first].rePoint(varInd2.second, varInd.second, type, nFields);
                 }
-                CNF nCnf = CNFcontainer[varInd.first].divide(nFields);
-                if (nCnf.get_nVar() > 0) CNFcontainer.push_back(nCnf);
+                std::optional<CNF> nCnf = CNFcontainer[varInd.first].divide(nFields);
+                if (nCnf) CNFcontainer.push_back(std::move(*nCnf));
                 if (CNFcontainer[varInd2.first].get_nVar() == 0) {
-                    CNFcontainer.erase(CNFcontainer.begin() + varInd2.first);
+                    CNFcontainer.erase(varInd2.first);
                 }
             }
         }
-        for (int i = 0; i< CNFcontainer.size(); i++){
-            CNFcontainer[i].printCNF();
+#ifdef NIR_COUNT_ALLOCS
+        eventAllocations()[i].count = allocations() - allocsBefore;     //вывод таблиц в счет события не входит
+        eventAllocations()[i].steady = componentShape(CNFcontainer) == shapeBefore;
+#endif
+        for (CNF& cnf: CNFcontainer.components()){
+            cnf.printCNF();
         }
         std::cout<<"i: "<<i<<std::endl;
     }
 }
 
 std::vector<std::vector<int>> CNF::buildCNF() {
+    compactSlots();
     std::vector<std::vector<int>> cnf;
     std::unordered_set<int> used_variables;
         
     // Основной алгоритм построения КНФ из графа связей
+    // Проходим только по единичным битам строк neg и раскладываем связи по i,
+    // чтобы клаузы шли в прежнем порядке: по i, внутри - по j.
+    // Переменные нумеруются в порядке ключей (после compactSlots это slotKey)
+    std::vector<std::vector<int>> sources(nVar + 1);
+    for (int j: keySlot) {
+        neg[j].forEachSetBit([&](int i) {
+            if (i <= nVar) sources[slotKey[i]].push_back(slotKey[j]);
+        });
+    }
     for (int i = 0; i <= nVar; i++) {
-        for (int j = 0; j <= nVar; j++) {
-            if (neg[j][i] == 1) {
-                // Каждое отношение neg[j][i] дает клаузу: -i ∨ j
-                std::vector<int> clause;
-                clause.push_back(-(i + 1)); // +1 чтобы избежать 0
-                clause.push_back(j + 1);
-                cnf.push_back(clause);
-                    
-                used_variables.insert(i + 1);
-                used_variables.insert(j + 1);
-            }
+        for (int j: sources[i]) {
+            // Каждое отношение neg[j][i] дает клаузу: -i ∨ j
+            std::vector<int> clause;
+            clause.push_back(-(i + 1)); // +1 чтобы избежать 0
+            clause.push_back(j + 1);
+            cnf.push_back(clause);
+                
+            used_variables.insert(i + 1);
+            used_variables.insert(j + 1);
         }
     }
     
@@ -1363,7 +3738,7 @@ bool CNF::isSatisfiableDPLL() {
         return true;
     }
         
-    DPLLSolver solver;
+    DPLLSolver solver(memory);
     for (const auto& clause : cnf) {
         solver.addClause(clause);
     }
@@ -1397,7 +3772,7 @@ void CNF::printCNFFormula() {
     }
 }
 
-void CNF::printDPLLResult(const std::unordered_map<std::string, int>& nameToIdTable) {
+void CNF::printDPLLResult(const std::unordered_map<Symbol, int>& nameToIdTable) {
     std::vector<std::vector<int>> cnf = buildCNF();
     
     std::cout << "CNF формула: " << std::endl;
@@ -1425,7 +3800,7 @@ void CNF::printDPLLResult(const std::unordered_map<std::string, int>& nameToIdTa
     std::cout << std::endl;
 }
 
-void CNF::analyzeVariableTable(const std::unordered_map<std::string, int>& nameToIdTable) {
+void CNF::analyzeVariableTable(const std::unordered_map<Symbol, int>& nameToIdTable) {
     std::vector<std::vector<int>> cnf = buildCNF();
     
     // Собираем статистику по переменным из ВСЕХ клауз CNF
@@ -1438,8 +3813,8 @@ void CNF::analyzeVariableTable(const std::unordered_map<std::string, int>& nameT
     // Проходим по всем клаузам в CNF
     for (const auto& clause : cnf) {
         // Определяем, является ли клауза черно-белой
-        bool is_white_clause = (clause.size() >= nVar); // более мягкое условие
-        bool is_black_clause = (clause.size() >= nVar);
+        bool is_white_clause = ((int)clause.size() >= nVar); // более мягкое условие
+        bool is_black_clause = ((int)clause.size() >= nVar);
         
         if (is_white_clause) {
             for (int lit : clause) {
@@ -1496,9 +3871,6 @@ void CNF::analyzeVariableTable(const std::unordered_map<std::string, int>& nameT
         int neg_regular = var_negative_regular[var];
         int total_regular = pos_regular + neg_regular;
         
-        int pos_all = var_positive_all[var];
-        int neg_all = var_negative_all[var];
-        
         // Критерии проблемных переменных:
         bool is_problematic = false;
         
@@ -1520,13 +3892,12 @@ void CNF::analyzeVariableTable(const std::unordered_map<std::string, int>& nameT
     if (!problematic_vars.empty()) {
         std::cout << "--- ПРОБЛЕМНЫЕ ПЕРЕМЕННЫЕ ---" << std::endl;
         for (int var : problematic_vars) {
-            int original_index = var - 1;
-            std::string var_name = (original_index >= 0 && original_index < var_names.size())
-                                 ? var_names[original_index] : "unknown";
-            
-            std::cout << "  - " << var_name;
+            int original_index = var - 1;             //номер в порядке ключей, кнф уплотнена
+            bool known = original_index >= 0 && original_index < (int)var_names.size();
+            if (known) original_index = keySlot[original_index];
+            std::cout << "  - " << (known ? symbols().name(var_names[original_index]) : "unknown");
             
-            auto it = nameToIdTable.find(var_name);
+            auto it = known ? nameToIdTable.find(var_names[original_index]) : nameToIdTable.end();
             if (it != nameToIdTable.end()) {
                 std::cout << " -> строка " << it->second;
                 std::cout << " [" << problem_type << "]";
@@ -1539,17 +3910,103 @@ void CNF::analyzeVariableTable(const std::unordered_map<std::string, int>& nameT
 }
 
 
-int main() {
-    std::ifstream data("/Users/liza/School/NIR/NIR/primer.json");
+#ifdef NIR_BENCH_KERNELS
+//Сборка с -DNIR_BENCH_KERNELS вместо разбора трассы замеряет проходы по строкам BitMatrix и BoolVector
+//с ядрами, выбранными при запуске (NIR_SIMD задает реализацию, см. tests/bench_kernels.sh).
+//Строки по 8192 бита почти пустые, единичный бит в конце - проходы читают строку целиком
+static int benchKernels() {
+    const int rows = 2048, bits = 8192, repeats = 200;
+    BitMatrix matrix;
+    matrix.reshape(rows, bits);
+    std::vector<BoolVector> vectors(rows, BoolVector(bits));
+    for (int i = 0; i < rows; i++) {
+        matrix.withRow(i, [&](auto row) { row.Set1(bits - 1 - i % 64); });
+        vectors[i].Set1(bits - 1);
+    }
+    auto measure = [&](const char *what, auto &&pass) {
+        auto start = std::chrono::steady_clock::now();
+        long found = 0;
+        for (int r = 0; r < repeats; r++) found += pass();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << what << ": " << std::fixed << std::setprecision(2) << ms / repeats << " мс на проход (" << found << ")" << std::endl;
+    };
+    std::cout << "ядра: " << bitKernels().name << std::endl;
+    measure("BitMatrix hasWeight", [&] {
+        long n = 0;
+        for (int i = 0; i < rows; i++) n += std::as_const(matrix).withRow(i, [](auto row) { return row.hasWeight(); });
+        return n;
+    });
+    measure("BoolVector ==", [&] {
+        long n = 0;
+        for (int i = 1; i < rows; i++) n += vectors[i] == vectors[i - 1];
+        return n;
+    });
+    measure("BoolVector |= и andNot", [&] {
+        for (int i = 1; i < rows; i++) {
+            vectors[i] |= vectors[i - 1];
+            vectors[i].andNot(vectors[0]);
+            vectors[i].Set1(bits - 1);
+        }
+        return 0L;
+    });
+    measure("BoolVector hasWeight", [&] {
+        long n = 0;
+        for (const BoolVector &vec: vectors) n += vec.hasWeight();
+        return n;
+    });
+    return 0;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+#ifdef NIR_BENCH_KERNELS
+    return benchKernels();
+#endif
+    //NIR [--sparse] [--check-allocs=N] трасса.json
+    //--sparse: хранить входящие связи списками (для куч из сотен тысяч объектов)
+    //--check-allocs=N (сборка с NIR_COUNT_ALLOCS): ошибка, если устоявшееся событие после N-го выделяло память
+    const char *usage = "использование: NIR [--sparse] [--check-allocs=N] трасса.json";
+    const std::string checkAllocsKey = "--check-allocs=";
+    int checkAllocsAfter = -1;
+    const char *tracePath = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--sparse") {
+            CNF::setSparseBackend(true);
+        } else if (arg.rfind(checkAllocsKey, 0) == 0) {
+            const char *first = arg.data() + checkAllocsKey.size();
+            const char *last = arg.data() + arg.size();
+            auto [end, err] = std::from_chars(first, last, checkAllocsAfter);
+            if (first == last || err != std::errc() || end != last || checkAllocsAfter < 0) {
+                std::cerr << "--check-allocs: нужно неотрицательное число событий, получено \"" << arg.substr(checkAllocsKey.size()) << "\"" << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--", 0) == 0 || tracePath) {
+            std::cerr << "неизвестный аргумент " << arg << std::endl << usage << std::endl;
+            return 1;
+        } else {
+            tracePath = argv[i];
+        }
+    }
+    if (!tracePath) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+#ifndef NIR_COUNT_ALLOCS
+    if (checkAllocsAfter >= 0) {
+        std::cerr << "--check-allocs работает только в сборке с -DNIR_COUNT_ALLOCS" << std::endl;
+        return 1;
+    }
+#endif
+    
+    std::ifstream data(tracePath);
     if (!data.is_open()) {
-        std::cerr << "Ошибка открытия файла" << std::endl;
+        std::cerr << "Ошибка открытия файла " << tracePath << std::endl;
         return 1;
     }
     
     //парсим json
     json parsedJSON = json::parse(data);
-    
-    std::vector<CNF> CNFcontainer;
                              
     //определяем тип - односвязный или двусвязный
     int fields_num = parsedJSON[0]["fields_num"];
@@ -1560,20 +4017,47 @@ int main() {
         fields.push_back(parsedJSON[0]["fields"][0]);
         fields.push_back(parsedJSON[0]["fields"][1]);
     }
-    //таблица соответствия
-    std::unordered_map<std::string, int> nameToIdTable;
-    //строим булеву таблицу
-    makeBoolLinks(parsedJSON, CNFcontainer, fields, nameToIdTable);
-    
-    std::cout << "\n=== РЕЗУЛЬТАТЫ SAT ПРОВЕРКИ ===" << std::endl;
-        for (int i = 0; i < CNFcontainer.size(); i++) {
-            std::cout << "\n=== CNF " << i + 1 << " ===" << std::endl;
-            CNFcontainer[i].printCNF();
+    //память кнф и их строк берется из пула и отдается разом, когда трасса разобрана.
+    //Пул передается явно, а не ставится ресурсом по умолчанию: временные объекты остаются в куче
+    //со всеми ее проверками (выход за границы в них не прячется внутри блоков пула)
+    std::pmr::unsynchronized_pool_resource traceMemory;
+#ifdef NIR_COUNT_ALLOCS
+    CountingResource countedMemory(&traceMemory);
+    std::pmr::memory_resource *cnfMemory = &countedMemory;
+#else
+    std::pmr::memory_resource *cnfMemory = &traceMemory;
+#endif
+    {
+        CNFList CNFcontainer(cnfMemory);
+        //таблица соответствия
+        std::unordered_map<Symbol, int> nameToIdTable;
+        //строим булеву таблицу
+        makeBoolLinks(parsedJSON, CNFcontainer, fields, nameToIdTable);
+        
+        std::cout << "\n=== РЕЗУЛЬТАТЫ SAT ПРОВЕРКИ ===" << std::endl;
+        int cnfNum = 0;
+        for (CNF& cnf: CNFcontainer.components()) {
+            std::cout << "\n=== CNF " << ++cnfNum << " ===" << std::endl;
+            cnf.printCNF();
                 
             std::cout << "--- SAT Анализ ---" << std::endl;
-            CNFcontainer[i].printDPLLResult(nameToIdTable);
+            cnf.printDPLLResult(nameToIdTable);
         }
-
+    }
+    traceMemory.release();
+#ifdef NIR_COUNT_ALLOCS
+    std::cout << "\n=== ВЫДЕЛЕНИЯ ПАМЯТИ ПО СОБЫТИЯМ (* - событие меняло состав компонент) ===" << std::endl;
+    int allocatingEvents = 0;
+    for (int i = 1; i < (int)eventAllocations().size(); i++) {
+        const EventAllocations &event = eventAllocations()[i];
+        std::cout << "i: " << i << " " << event.count << (event.steady ? "" : " *") << std::endl;
+        if (checkAllocsAfter >= 0 && i > checkAllocsAfter && event.steady && event.count > 0) {
+            std::cerr << "событие " << i << " после прогрева выделило память " << event.count << " раз" << std::endl;
+            allocatingEvents++;
+        }
+    }
+    if (allocatingEvents > 0) return 2;
+#endif
                             
     data.close();
                             
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Замер ядер проходов по строкам (BitMatrix, BoolVector): собирает NIR с -DNIR_BENCH_KERNELS и запускает
+# с каждой реализацией, которую поддерживает процессор (NIR_SIMD), затем проверяет, что разбор
+# primer.json со скалярными ядрами дает тот же вывод, что с выбранными по умолчанию.
+# Запуск из корня репозитория: tests/bench_kernels.sh [компилятор]
+set -e
+CXX=${1:-${CXX:-c++}}
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+"$CXX" -std=c++20 -O2 -DNIR_BENCH_KERNELS -I "$root/NIR" "$root/NIR/main.cpp" -o "$build/bench"
+"$CXX" -std=c++20 -O2 -I "$root/NIR" "$root/NIR/main.cpp" -o "$build/nir"
+
+for simd in scalar avx2 avx512; do
+    NIR_SIMD=$simd "$build/bench"
+    echo
+done
+
+"$build/nir" "$root/NIR/primer.json" > "$build/default.txt"
+NIR_SIMD=scalar "$build/nir" "$root/NIR/primer.json" > "$build/scalar.txt"
+if ! cmp -s "$build/default.txt" "$build/scalar.txt"; then
+    echo "FAIL: вывод со скалярными ядрами отличается" >&2
+    exit 1
+fi
+echo "OK"
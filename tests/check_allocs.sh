@@ -0,0 +1,28 @@
+#!/bin/sh
+# Регрессионная проверка выделений памяти: собирает NIR с -DNIR_COUNT_ALLOCS и разбирает primer.json
+# с --check-allocs. Первые WARMUP событий - прогрев (узлы впервые получают входящие связи, растут
+# рабочие массивы); после него устоявшиеся события не должны обращаться ни к куче, ни к пулу трассы.
+# Запуск из корня репозитория: tests/check_allocs.sh [компилятор]
+set -e
+CXX=${1:-${CXX:-c++}}
+WARMUP=30
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+"$CXX" -std=c++20 -O2 -DNIR_COUNT_ALLOCS -I "$root/NIR" "$root/NIR/main.cpp" -o "$build/nir"
+
+if ! "$build/nir" --check-allocs=$WARMUP "$root/NIR/primer.json" > "$build/out.txt"; then
+    echo "FAIL: устоявшиеся события после $WARMUP-го выделяли память" >&2
+    exit 1
+fi
+
+# неверное число событий - ошибка разбора аргумента, а не исключение
+for arg in --check-allocs= --check-allocs=x --check-allocs=-1 --check-allocs=5x; do
+    if "$build/nir" "$arg" "$root/NIR/primer.json" > /dev/null 2>&1; then
+        echo "FAIL: аргумент $arg принят" >&2
+        exit 1
+    fi
+done
+
+echo "OK"
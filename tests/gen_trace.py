@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Случайная трасса для NIR в формате primer.json: объявления указателей, malloc, присваивания,
+# записи в поля next/prev, чтение полей и free. Модель кучи нужна только чтобы события были
+# осмысленными (не читать поле освобожденного узла), утечки и висящие указатели в трассе допустимы.
+# Запуск: tests/gen_trace.py зерно шагов трасса.json [число полей 1|2]
+import json
+import random
+import sys
+
+seed, steps, path = int(sys.argv[1]), int(sys.argv[2]), sys.argv[3]
+rnd = random.Random(seed)
+nfields = int(sys.argv[4]) if len(sys.argv) > 4 else rnd.choice([1, 2])
+fields = ["next"] if nfields == 1 else ["next", "prev"]
+
+events = [{"fields_num": 1, "field": "next"} if nfields == 1 else {"fields_num": 2, "fields": fields}]
+line = 10
+def emit(event):
+    global line
+    line += 1
+    events.append(dict(id=line, **event))
+
+names = ["v%d" % i for i in range(8)]
+target = {}         # переменная -> None (не инициализирована или висит), 'NULL' или номер узла
+nodes = {}          # узел -> {поле: цель}
+allocated = 0
+def malloc():
+    global allocated
+    allocated += 1
+    nodes[allocated] = {}
+    return allocated
+
+for _ in range(steps):
+    k = rnd.random()
+    undeclared = [v for v in names if v not in target]
+    ptrs = [v for v in target if isinstance(target[v], int)]
+    if undeclared and (k < 0.08 or not target):
+        v = rnd.choice(undeclared)
+        c = rnd.random()
+        if c < 0.3:
+            emit({"name": v})
+            target[v] = None
+        elif c < 0.6:
+            emit({"name": v, "value": "NULL"})
+            target[v] = 'NULL'
+        else:
+            node = malloc()
+            emit({"name": v, "value": "N%d" % node})
+            target[v] = node
+        continue
+    v = rnd.choice(list(target))
+    if k < 0.3:                                     # v = malloc
+        node = malloc()
+        emit({"name": v, "value": "N%d" % node})
+        target[v] = node
+    elif k < 0.55 and ptrs:                         # p->f = q / NULL
+        p, f = rnd.choice(ptrs), rnd.choice(fields)
+        if rnd.random() < 0.25:
+            emit({"name": p, "f": f, "value": "NULL"})
+            nodes[target[p]][f] = 'NULL'
+        else:
+            q = rnd.choice(ptrs)
+            emit({"name": p, "f": f, "value": q})
+            nodes[target[p]][f] = target[q]
+    elif k < 0.75:                                  # v = q
+        q = rnd.choice(list(target))
+        if q == v or target[q] is None:
+            continue
+        emit({"name": v, "value": q if target[q] != 'NULL' else "NULL"})
+        target[v] = target[q]
+    elif k < 0.88 and ptrs:                         # v = q->f
+        q, f = rnd.choice(ptrs), rnd.choice(fields)
+        t = nodes[target[q]].get(f)
+        if not isinstance(t, int) or t not in nodes:
+            continue
+        emit({"name": v, "value": {"name": q, "f": f}})
+        target[v] = t
+    elif k < 0.93:                                  # v = NULL
+        emit({"name": v, "value": "NULL"})
+        target[v] = 'NULL'
+    elif ptrs and rnd.random() < 0.5:               # free(p)
+        p = rnd.choice(ptrs)
+        node = target[p]
+        emit({"name": p, "op": "free"})
+        del nodes[node]
+        for x in target:
+            if target[x] == node:
+                target[x] = None
+        for fs in nodes.values():
+            for f in fs:
+                if fs[f] == node:
+                    fs[f] = None
+
+with open(path, "w") as out:
+    json.dump(events, out, indent=1)